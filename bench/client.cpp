@@ -0,0 +1,66 @@
+// Cost of constructing clients and connecting to the local WMI service.
+#include "wmi.hpp"
+
+#include <benchmark/benchmark.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    // Keeps COM initialized on the benchmark thread for the clients that expect the caller to do it.
+    struct ComApartment {
+        ComApartment() { initialized = SUCCEEDED( CoInitializeEx( nullptr, COINIT_MULTITHREADED ) ); }
+        ~ComApartment() { if ( initialized ) { CoUninitialize(); } }
+
+        bool initialized = false;
+    };
+
+    void Construct(benchmark::State &state, const ConnectionOptions &connection) {
+        // The pool's connection is made before timing starts, so pooled clients measure reuse.
+        if ( connection.pooled ) { WindowsManagementInstrumentationClient warm( connection ); }
+
+        for ( auto _: state ) {
+            WindowsManagementInstrumentationClient client( connection );
+            benchmark::DoNotOptimize( client );
+        }
+        state.SetItemsProcessed( state.iterations() );
+    }
+
+    void ConstructCallerManaged(benchmark::State &state, const bool pooled) {
+        ComApartment apartment;
+        Construct( state, { .pooled = pooled, .threading = ComThreading::CallerManaged } );
+    }
+
+    void PoolAcquire(benchmark::State &state) {
+        ComApartment apartment;
+        const ConnectionOptions connection;
+        benchmark::DoNotOptimize( ConnectionPool::instance().acquire( connection ) );
+
+        for ( auto _: state ) { benchmark::DoNotOptimize( ConnectionPool::instance().acquire( connection ) ); }
+        state.SetItemsProcessed( state.iterations() );
+    }
+
+    // A new client's first query, with and without schemas cached by earlier clients.
+    void FirstQuery(benchmark::State &state, const bool coldSchemas) {
+        for ( auto _: state ) {
+            if ( coldSchemas ) {
+                state.PauseTiming();
+                SchemaCache::instance().clear();
+                state.ResumeTiming();
+            }
+            WindowsManagementInstrumentationClient client;
+            auto results = client.getProperties( L"Win32_OperatingSystem", { L"Caption", L"Version" } );
+            benchmark::DoNotOptimize( results );
+        }
+        state.SetItemsProcessed( state.iterations() );
+    }
+}
+
+BENCHMARK_CAPTURE( Construct, Pooled, ConnectionOptions{} )->Unit( benchmark::kMicrosecond );
+BENCHMARK_CAPTURE( Construct, Unpooled, ConnectionOptions{ .pooled = false } )->Unit( benchmark::kMillisecond );
+BENCHMARK_CAPTURE( Construct, PooledWorker, ConnectionOptions{ .threading = ComThreading::Worker } )
+    ->Unit( benchmark::kMicrosecond );
+BENCHMARK_CAPTURE( ConstructCallerManaged, Pooled, true )->Unit( benchmark::kMicrosecond );
+BENCHMARK_CAPTURE( ConstructCallerManaged, Unpooled, false )->Unit( benchmark::kMillisecond );
+BENCHMARK( PoolAcquire )->Unit( benchmark::kMicrosecond );
+BENCHMARK_CAPTURE( FirstQuery, CachedSchemas, false )->Unit( benchmark::kMillisecond );
+BENCHMARK_CAPTURE( FirstQuery, ColdSchemas, true )->Unit( benchmark::kMillisecond );
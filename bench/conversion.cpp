@@ -0,0 +1,142 @@
+// VARIANT -> WmiValue conversion on synthetic inputs, without WMI. Inputs are built with the same
+// VARIANT types WMI hands out for each CIM type.
+#include "wmi.hpp"
+
+#include <benchmark/benchmark.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    template< CIMTYPE Type >
+    auto sample() {
+        if constexpr ( Type == CIM_STRING ) return std::wstring( L"C:\\Windows\\System32\\svchost.exe" );
+        else if constexpr ( Type == CIM_DATETIME ) return std::wstring( L"20240101120000.000000+000" );
+        else if constexpr ( Type == CIM_REFERENCE ) return std::wstring( L"\\\\HOST\\root\\cimv2:Win32_Process.Handle=\"4\"" );
+        else if constexpr ( Type == CIM_BOOLEAN ) return true;
+        else if constexpr ( Type == CIM_CHAR16 ) return L'W';
+        else return static_cast< typename utils::CimScalar< Type >::type >( 100 );
+    }
+
+    template< CIMTYPE Type >
+    void ConvertScalar(benchmark::State &state) {
+        utils::Variant input;
+        utils::writeVariant( input.get(), Type, sample< Type >() );
+
+        WmiValue out;
+        for ( auto _: state ) {
+            utils::convertVariant( input.get(), Type, out );
+            benchmark::DoNotOptimize( out );
+        }
+        state.SetItemsProcessed( state.iterations() );
+    }
+
+    // The std::map of std::function converters that convertVariant replaced, kept as the baseline
+    // for ConvertScalar: one tree lookup and one indirect call, then a new WmiValue per property.
+    WmiValue mapDispatch(VARIANT &v, const CIMTYPE cimType) {
+        using Converter = std::function< WmiValue(VARIANT &) >;
+        static const std::map< CIMTYPE, Converter > converters = [] {
+            std::map< CIMTYPE, Converter > map;
+            for ( const CIMTYPE type: { CIM_BOOLEAN, CIM_SINT8, CIM_UINT8, CIM_SINT16, CIM_UINT16, CIM_SINT32, CIM_UINT32,
+                                        CIM_SINT64, CIM_UINT64, CIM_REAL32, CIM_REAL64, CIM_CHAR16, CIM_STRING,
+                                        CIM_DATETIME, CIM_REFERENCE } ) {
+                utils::visitCimType( type, [&]< CIMTYPE Type > () {
+                    map.emplace( Type, [] (VARIANT &value) -> WmiValue {
+                        using T = typename utils::CimScalar< Type >::type;
+                        return T( utils::CimScalar< Type >::read( value ) );
+                    } );
+                } );
+            }
+            return map;
+        }();
+
+        const auto it = converters.find( cimType );
+        if ( it == converters.end() ) throw utils::Exception( E_NOTIMPL );
+        return it->second( v );
+    }
+
+    template< CIMTYPE Type >
+    void ConvertScalarMapDispatch(benchmark::State &state) {
+        utils::Variant input;
+        utils::writeVariant( input.get(), Type, sample< Type >() );
+
+        for ( auto _: state ) {
+            WmiValue out = mapDispatch( input.get(), Type );
+            benchmark::DoNotOptimize( out );
+        }
+        state.SetItemsProcessed( state.iterations() );
+    }
+
+    template< CIMTYPE Type >
+    void ConvertArray(benchmark::State &state) {
+        using Element = decltype( sample< Type >() );
+        const std::vector< Element > values( static_cast< std::size_t >( state.range( 0 ) ), sample< Type >() );
+
+        utils::Variant input;
+        utils::writeVariant( input.get(), Type | CIM_FLAG_ARRAY, values );
+
+        WmiValue out;
+        for ( auto _: state ) {
+            utils::convertVariant( input.get(), Type | CIM_FLAG_ARRAY, out );
+            benchmark::DoNotOptimize( out );
+        }
+        state.SetItemsProcessed( state.iterations() * state.range( 0 ) );
+    }
+
+    // Scalar strings copied into an arena instead of a std::wstring, as with QueryOptions::arena.
+    void ConvertStringIntoArena(benchmark::State &state) {
+        utils::Variant input;
+        utils::writeVariant( input.get(), CIM_STRING, sample< CIM_STRING >() );
+
+        std::pmr::monotonic_buffer_resource arena;
+        WmiValue out;
+        std::size_t converted = 0;
+        for ( auto _: state ) {
+            utils::convertVariant( input.get(), CIM_STRING, out, StringStorage::Copy, &arena );
+            benchmark::DoNotOptimize( out );
+            if ( ++converted % 4096 == 0 ) { arena.release(); }
+        }
+        state.SetItemsProcessed( state.iterations() );
+    }
+
+    void arraySizes(benchmark::internal::Benchmark *bench) { bench->RangeMultiplier( 8 )->Range( 1, 4096 ); }
+}
+
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_BOOLEAN );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_SINT8 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_UINT8 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_SINT16 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_UINT16 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_SINT32 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_UINT32 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_SINT64 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_UINT64 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_REAL32 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_REAL64 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_CHAR16 );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_STRING );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_DATETIME );
+BENCHMARK_TEMPLATE( ConvertScalar, CIM_REFERENCE );
+
+BENCHMARK_TEMPLATE( ConvertScalarMapDispatch, CIM_BOOLEAN );
+BENCHMARK_TEMPLATE( ConvertScalarMapDispatch, CIM_UINT32 );
+BENCHMARK_TEMPLATE( ConvertScalarMapDispatch, CIM_UINT64 );
+BENCHMARK_TEMPLATE( ConvertScalarMapDispatch, CIM_REAL64 );
+BENCHMARK_TEMPLATE( ConvertScalarMapDispatch, CIM_STRING );
+
+BENCHMARK_TEMPLATE( ConvertArray, CIM_BOOLEAN )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_SINT8 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_UINT8 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_SINT16 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_UINT16 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_SINT32 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_UINT32 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_SINT64 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_UINT64 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_REAL32 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_REAL64 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_CHAR16 )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_STRING )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_DATETIME )->Apply( arraySizes );
+BENCHMARK_TEMPLATE( ConvertArray, CIM_REFERENCE )->Apply( arraySizes );
+
+BENCHMARK( ConvertStringIntoArena );
@@ -0,0 +1,104 @@
+// End-to-end queries against the local WMI service. Besides the time per query, every benchmark
+// reports the time per object and per property, which stays comparable across machines with
+// different numbers of processes, processors and devices.
+#include "wmi.hpp"
+
+#include <benchmark/benchmark.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    WindowsManagementInstrumentationClient &client() {
+        static WindowsManagementInstrumentationClient instance;
+        return instance;
+    }
+
+    std::size_t propertiesOf(const WindowsManagementInstrumentationObject &obj) {
+        return obj.schema() ? obj.schema()->size() : 0;
+    }
+
+    void reportCounts(benchmark::State &state, const std::size_t objects, const std::size_t properties) {
+        const auto invertedRate = benchmark::Counter::kIsRate | benchmark::Counter::kInvert;
+        state.counters[ "objects" ] = benchmark::Counter( static_cast< double >( objects ), benchmark::Counter::kAvgIterations );
+        state.counters[ "per_object" ] = benchmark::Counter( static_cast< double >( objects ), invertedRate );
+        state.counters[ "per_property" ] = benchmark::Counter( static_cast< double >( properties ), invertedRate );
+    }
+
+    void GetProperties(benchmark::State &state, const wchar_t *className, const QueryOptions &options) {
+        std::size_t objects = 0;
+        std::size_t properties = 0;
+        for ( auto _: state ) {
+            auto results = client().getProperties( Query( className ), options );
+            objects += results.size();
+            for ( const auto &obj: results ) { properties += propertiesOf( obj ); }
+            benchmark::DoNotOptimize( results );
+        }
+        reportCounts( state, objects, properties );
+    }
+
+    void Prepared(benchmark::State &state, const wchar_t *className) {
+        auto query = client().prepare( Query( className ) );
+        std::size_t objects = 0;
+        std::size_t properties = 0;
+        for ( auto _: state ) {
+            const auto results = query.execute();
+            objects += results.size();
+            for ( const auto &obj: results ) { properties += propertiesOf( obj ); }
+        }
+        reportCounts( state, objects, properties );
+    }
+
+    void Table(benchmark::State &state, const wchar_t *className) {
+        std::size_t objects = 0;
+        std::size_t properties = 0;
+        for ( auto _: state ) {
+            auto table = client().getTable( Query( className ) );
+            objects += table.rows();
+            properties += table.rows() * table.columns().size();
+            benchmark::DoNotOptimize( table );
+        }
+        reportCounts( state, objects, properties );
+    }
+
+    void Stream(benchmark::State &state, const wchar_t *className) {
+        std::size_t objects = 0;
+        std::size_t properties = 0;
+        for ( auto _: state ) {
+            client().streamProperties( Query( className ), [&] (WindowsManagementInstrumentationObject &&obj) {
+                ++objects;
+                properties += propertiesOf( obj );
+            } );
+        }
+        reportCounts( state, objects, properties );
+    }
+
+    struct Class {
+        std::string name;
+        const wchar_t *className;
+    };
+
+    // A large class, a performance class with one instance per processor and a class with wide objects.
+    const Class classes[] = {
+        { "Win32_Process", L"Win32_Process" },
+        { "Win32_PerfFormattedData_PerfOS_Processor", L"Win32_PerfFormattedData_PerfOS_Processor" },
+        { "Win32_PnPEntity", L"Win32_PnPEntity" },
+    };
+
+    [[maybe_unused]] const bool registered = [] {
+        const auto add = [] (const std::string &name, auto function, auto... args) {
+            benchmark::RegisterBenchmark( name.c_str(), function, args... )->Unit( benchmark::kMillisecond );
+        };
+        const QueryOptions objectAccess{ .useObjectAccess = true };
+        const QueryOptions bstr{ .strings = StringStorage::Bstr };
+
+        for ( const auto &[name, className]: classes ) {
+            add( "GetProperties/" + name, GetProperties, className, QueryOptions{} );
+            add( "GetProperties/" + name + "/ObjectAccess", GetProperties, className, objectAccess );
+            add( "GetProperties/" + name + "/Bstr", GetProperties, className, bstr );
+            add( "Prepared/" + name, Prepared, className );
+            add( "Table/" + name, Table, className );
+            add( "Stream/" + name, Stream, className );
+        }
+        return true;
+    }();
+}
@@ -0,0 +1,156 @@
+// Asynchronous queries stop and time out without blocking the threads that deliver them.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+using namespace SimplerWMI;
+using namespace std::chrono_literals;
+
+namespace {
+    class AsyncQueryTest : public fakes::ClientTest {
+    protected:
+        // CancelAsyncCall goes out from the watchdog's thread.
+        bool cancelledOnce() const {
+            const auto deadline = std::chrono::steady_clock::now() + 10s;
+            while ( services->cancellations == 0 && std::chrono::steady_clock::now() < deadline ) { std::this_thread::sleep_for( 1ms ); }
+            return services->cancellations == 1;
+        }
+    };
+}
+
+TEST_F(AsyncQueryTest, VisitorCanCancelItsOwnQuery) {
+    for ( int i = 0; i < 3; ++i ) { services->add( L"Test_Async" ).set( L"Index", CIM_UINT32, static_cast< uint32_t >( i ) ); }
+
+    std::stop_source stop;
+    int visited = 0;
+    QueryOptions options;
+    options.cancellation = stop.get_token();
+    const AsyncQuery query = client.streamPropertiesAsync(
+        L"Test_Async", { L"Index" },
+        [&] (WindowsManagementInstrumentationObject &&) {
+            ++visited;
+            stop.request_stop();
+        },
+        options );
+
+    // Delivered from another thread, as WMI does, so a deadlock fails the test instead of hanging it.
+    auto delivered = std::async( std::launch::async, [&] { services->deliver(); } );
+    ASSERT_EQ( delivered.wait_for( 10s ), std::future_status::ready );
+    ASSERT_TRUE( query.waitFor( 0s ) );
+    EXPECT_EQ( visited, 1 );
+    try {
+        query.get();
+        FAIL() << "the query was not cancelled";
+    }
+    catch ( const utils::Exception &e ) {
+        EXPECT_EQ( e.hresult(), WBEM_E_CALL_CANCELLED );
+    }
+}
+
+TEST_F(AsyncQueryTest, StoppingVisitorCancelsTheCall) {
+    for ( int i = 0; i < 3; ++i ) { services->add( L"Test_Async" ).set( L"Index", CIM_UINT32, static_cast< uint32_t >( i ) ); }
+
+    int visited = 0;
+    const AsyncQuery query = client.streamPropertiesAsync(
+        Query( L"Test_Async" ).select( { L"Index" } ),
+        [&] (WindowsManagementInstrumentationObject &&) {
+            ++visited;
+            return false;
+        } );
+
+    // Completed by the visitor itself, without waiting for the rest of the enumeration.
+    IWbemClassObject *first = services->objects[ 0 ].get();
+    services->sink->Indicate( 1, &first );
+    ASSERT_TRUE( query.waitFor( 0s ) );
+    EXPECT_NO_THROW( query.get() );
+    EXPECT_EQ( visited, 1 );
+    EXPECT_TRUE( cancelledOnce() );
+    services->deliver();
+    EXPECT_EQ( visited, 1 );
+}
+
+TEST_F(AsyncQueryTest, ThrowingVisitorCancelsTheCall) {
+    services->add( L"Test_Async" ).set( L"Index", CIM_UINT32, 0u );
+
+    const AsyncQuery query = client.streamPropertiesAsync(
+        Query( L"Test_Async" ).select( { L"Index" } ),
+        [] (WindowsManagementInstrumentationObject &&) -> bool { throw std::runtime_error( "visitor failed" ); } );
+
+    IWbemClassObject *first = services->objects[ 0 ].get();
+    services->sink->Indicate( 1, &first );
+    ASSERT_TRUE( query.waitFor( 0s ) );
+    EXPECT_THROW( query.get(), std::runtime_error );
+    EXPECT_TRUE( cancelledOnce() );
+    services->deliver();
+}
+
+TEST_F(AsyncQueryTest, WorkerTimeoutsDoNotWaitForTheWorker) {
+    // Keeps the worker busy for the whole test.
+    std::promise< void > release;
+    auto busy = std::async( std::launch::async, [future = release.get_future()] {
+        utils::ComWorker::instance().run( [&future] { future.wait(); } );
+    } );
+
+    std::vector< std::promise< HRESULT > > results( 2 );
+    std::vector< utils::ComPtr< ObjectSink > > sinks;
+    for ( std::size_t i = 0; i < results.size(); ++i ) {
+        QueryOptions options;
+        options.timeout = std::chrono::milliseconds( 10 * ( i + 1 ) );
+        sinks.emplace_back( new ObjectSink(
+            ComThreading::Worker, L"*async", options,
+            [] (WindowsManagementInstrumentationObject &&) { return true; },
+            [&results, i] (HRESULT hr, std::exception_ptr) { results[ i ].set_value( hr ); } ) );
+        sinks.back()->watch( utils::ComPtr< IWbemServices >( services.get() ) );
+    }
+
+    // The second timeout only fires if the first one did not leave the watchdog waiting for the worker.
+    for ( auto &result : results ) {
+        auto future = result.get_future();
+        ASSERT_EQ( future.wait_for( 10s ), std::future_status::ready );
+        EXPECT_EQ( future.get(), WBEM_E_TIMED_OUT );
+    }
+
+    release.set_value();
+    busy.get();
+    utils::ComWorker::instance().run( [] {} );
+    EXPECT_EQ( services->cancellations, 2 );
+}
+
+TEST_F(AsyncQueryTest, ObjectsAreNeverLazy) {
+    services->add( L"Test_Async" ).set( L"Index", CIM_UINT32, 1u );
+
+    auto pending = client.getPropertiesAsync( L"Test_Async", { L"Index" }, { .lazy = true } );
+    services->deliver();
+    // A lazy object would read the value only now.
+    services->objects[ 0 ]->set( L"Index", CIM_UINT32, 2u );
+
+    const auto objects = pending.get();
+    ASSERT_EQ( objects.size(), 1u );
+    EXPECT_EQ( objects[ 0 ].getProperty< uint32_t >( L"Index" ), 1u );
+}
+
+TEST_F(AsyncQueryTest, FutureIsCancelledThroughItsStopToken) {
+    services->add( L"Test_Async" ).set( L"Index", CIM_UINT32, 0u );
+
+    std::stop_source stop;
+    QueryOptions options;
+    options.cancellation = stop.get_token();
+    auto pending = client.getPropertiesAsync( L"Test_Async", { L"Index" }, options );
+
+    // Completed without waiting for WMI to acknowledge the cancellation.
+    stop.request_stop();
+    ASSERT_EQ( pending.wait_for( 0s ), std::future_status::ready );
+    try {
+        pending.get();
+        FAIL() << "the query was not cancelled";
+    }
+    catch ( const utils::Exception &e ) {
+        EXPECT_EQ( e.hresult(), WBEM_E_CALL_CANCELLED );
+    }
+    EXPECT_TRUE( cancelledOnce() );
+    services->deliver();
+}
@@ -0,0 +1,48 @@
+// Results shared through getCached never cross from one connection to another.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    class ResultCacheTest : public fakes::ClientTest {};
+}
+
+TEST_F(ResultCacheTest, KeepsWrappedClientsApart) {
+    ResultCache cache;
+    services->add( L"Test_Cached" ).set( L"Name", CIM_STRING, L"first" );
+    const auto second = fakes::make< fakes::Services >();
+    second->add( L"Test_Cached" ).set( L"Name", CIM_STRING, L"second" );
+    WindowsManagementInstrumentationClient secondClient( second.get() );
+    client.setResultCache( cache );
+    secondClient.setResultCache( cache );
+
+    const ResultCache::Result fromFirst = client.getCached( L"Test_Cached", { L"Name" } );
+    const ResultCache::Result fromSecond = secondClient.getCached( L"Test_Cached", { L"Name" } );
+    ASSERT_EQ( fromFirst->size(), 1u );
+    ASSERT_EQ( fromSecond->size(), 1u );
+    EXPECT_EQ( fromFirst->front().getProperty< std::wstring >( L"Name" ), L"first" );
+    EXPECT_EQ( fromSecond->front().getProperty< std::wstring >( L"Name" ), L"second" );
+
+    // The same client still shares its own result.
+    EXPECT_EQ( client.getCached( L"Test_Cached", { L"Name" } ), fromFirst );
+}
+
+TEST(ResultCache, KeepsPasswordsOfOneAccountApart) {
+    const ConnectionOptions first{ .host = L"server", .user = L"CONTOSO\\reader", .password = L"right" };
+    ConnectionOptions second = first;
+    second.password = L"wrong";
+
+    const std::wstring path = utils::serverPath( first );
+    const utils::Credentials firstCredentials = utils::authIdentity( first.user, first.password );
+    const utils::Credentials secondCredentials = utils::authIdentity( second.user, second.password );
+    const std::wstring firstKey = utils::connectionKey( path, first, firstCredentials );
+    const std::wstring secondKey = utils::connectionKey( path, second, secondCredentials );
+    EXPECT_NE( firstKey, secondKey );
+    EXPECT_EQ( firstKey.find( L"right" ), std::wstring::npos );
+    EXPECT_EQ( secondKey.find( L"wrong" ), std::wstring::npos );
+
+    // Clients with the same credentials still share their results.
+    EXPECT_EQ( utils::connectionKey( path, first, utils::authIdentity( first.user, first.password ) ), firstKey );
+}
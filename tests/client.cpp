@@ -0,0 +1,32 @@
+// A client wrapping a caller's IWbemServices runs its queries on that proxy alone.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+TEST(WrappedClient, RejectsANullProxy) {
+    EXPECT_THROW( WindowsManagementInstrumentationClient( static_cast< IWbemServices * >( nullptr ) ), utils::Exception );
+}
+
+TEST(WrappedClient, QueriesTheWrappedProxy) {
+    const auto services = fakes::make< fakes::Services >();
+    services->add( L"Test_Client" ).set( L"Name", CIM_STRING, L"first" ).set( L"Count", CIM_UINT32, 1u );
+    services->add( L"Test_Client" ).set( L"Name", CIM_STRING, L"second" ).set( L"Count", CIM_UINT32, 2u );
+    WindowsManagementInstrumentationClient client( services.get() );
+
+    const auto objects = client.getProperties( L"Test_Client", { L"Name", L"Count" } );
+    ASSERT_EQ( objects.size(), 2u );
+    EXPECT_EQ( objects[ 0 ].getProperty< std::wstring >( L"Name" ), L"first" );
+    EXPECT_EQ( objects[ 1 ].getProperty< uint32_t >( L"Count" ), 2u );
+    EXPECT_EQ( services->queries, ( std::vector< std::wstring >{ L"SELECT Name,Count FROM Test_Client" } ) );
+}
+
+TEST(WrappedClient, KeepsItsOwnReference) {
+    auto services = fakes::make< fakes::Services >();
+    services->add( L"Test_Client" ).set( L"Name", CIM_STRING, L"kept" );
+    WindowsManagementInstrumentationClient client( services.get() );
+    services.reset();
+
+    EXPECT_EQ( client.getProperties( L"Test_Client" ).size(), 1u );
+}
@@ -0,0 +1,117 @@
+// VARIANT conversion through the client: typed values, and NULL properties kept apart from zero.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    class ConversionTest : public fakes::ClientTest {
+    protected:
+        std::vector< WindowsManagementInstrumentationObject > query(const QueryOptions &options = {}) {
+            return client.getProperties( Query( L"Test_Process" ), options );
+        }
+    };
+}
+
+TEST(Conversion, NullScalarsAndArraysAreMonostate) {
+    utils::Variant null;
+    null.get().vt = VT_NULL;
+
+    WmiValue value = uint32_t( 7 );
+    utils::convertVariant( null.get(), CIM_UINT32, value );
+    EXPECT_TRUE( std::holds_alternative< std::monostate >( value ) );
+
+    value = std::wstring( L"kept" );
+    utils::convertVariant( null.get(), CIM_STRING, value, StringStorage::Bstr );
+    EXPECT_TRUE( std::holds_alternative< std::monostate >( value ) );
+
+    std::pmr::monotonic_buffer_resource arena;
+    utils::convertVariant( null.get(), CIM_STRING, value, StringStorage::Copy, &arena );
+    EXPECT_TRUE( std::holds_alternative< std::monostate >( value ) );
+
+    utils::convertVariant( null.get(), CIM_SINT32 | CIM_FLAG_ARRAY, value );
+    EXPECT_TRUE( std::holds_alternative< std::monostate >( value ) );
+}
+
+TEST_F(ConversionTest, NullPropertiesReadAsMissing) {
+    addProcess( 0 )
+        .setNull( L"ParentProcessId", CIM_UINT32 )
+        .setNull( L"CommandLine", CIM_STRING )
+        .setNull( L"Threads", CIM_UINT32 | CIM_FLAG_ARRAY );
+    addProcess( 4 )
+        .set( L"ParentProcessId", CIM_UINT32, uint32_t( 0 ) )
+        .set( L"CommandLine", CIM_STRING, L"" )
+        .set( L"Threads", CIM_UINT32 | CIM_FLAG_ARRAY, std::vector< uint32_t >{ 1, 2 } );
+
+    for ( const auto &options: { QueryOptions(), QueryOptions{ .lazy = true } } ) {
+        const auto objects = query( options );
+        ASSERT_EQ( objects.size(), 2u );
+
+        EXPECT_EQ( objects[ 0 ].getProperty< uint32_t >( L"ProcessId" ), 0u );
+        EXPECT_EQ( objects[ 0 ].getProperty< uint32_t >( L"ParentProcessId" ), std::nullopt );
+        EXPECT_EQ( objects[ 0 ].getPropertyView( L"CommandLine" ), std::nullopt );
+        EXPECT_TRUE( objects[ 0 ].getArray< uint32_t >( L"Threads" ).empty() );
+
+        // The second object reuses the first one's schema, and its values are not NULL.
+        EXPECT_EQ( objects[ 1 ].getProperty< uint32_t >( L"ParentProcessId" ), 0u );
+        EXPECT_EQ( objects[ 1 ].getPropertyView( L"CommandLine" ), L"" );
+        EXPECT_EQ( objects[ 1 ].getArray< uint32_t >( L"Threads" ).size(), 2u );
+    }
+}
+
+TEST_F(ConversionTest, ConvertsEveryScalarType) {
+    services->add( L"Test_Process" )
+        .set( L"Flag", CIM_BOOLEAN, true )
+        .set( L"Small", CIM_SINT8, int8_t( -8 ) )
+        .set( L"Short", CIM_UINT16, uint16_t( 65535 ) )
+        .set( L"Signed", CIM_SINT32, -32 )
+        .set( L"Large", CIM_UINT64, uint64_t( 18446744073709551615ull ) )
+        .set( L"Ratio", CIM_REAL64, 0.5 )
+        .set( L"Letter", CIM_CHAR16, L'W' )
+        .set( L"Started", CIM_DATETIME, L"20240101120000.000000+000" );
+
+    const auto objects = query();
+    ASSERT_EQ( objects.size(), 1u );
+    const auto &obj = objects[ 0 ];
+    EXPECT_EQ( obj.getProperty< bool >( L"Flag" ), true );
+    EXPECT_EQ( obj.getProperty< int8_t >( L"Small" ), -8 );
+    EXPECT_EQ( obj.getProperty< uint16_t >( L"Short" ), 65535 );
+    EXPECT_EQ( obj.getProperty< int32_t >( L"Signed" ), -32 );
+    EXPECT_EQ( obj.getProperty< uint64_t >( L"Large" ), 18446744073709551615ull );
+    EXPECT_EQ( obj.getProperty< double >( L"Ratio" ), 0.5 );
+    EXPECT_EQ( obj.getProperty< wchar_t >( L"Letter" ), L'W' );
+    EXPECT_EQ( obj.getPropertyView( L"Started" ), L"20240101120000.000000+000" );
+    // Another type than the stored one reads as missing.
+    EXPECT_EQ( obj.getProperty< uint32_t >( L"Signed" ), std::nullopt );
+}
+
+TEST_F(ConversionTest, ObjectAccessReadsNullAsMissing) {
+    addProcess( 1 ).set( L"ParentProcessId", CIM_UINT32, uint32_t( 0 ) );
+    auto &second = addProcess( 2 ).setNull( L"ParentProcessId", CIM_UINT32 );
+    second.setNull( L"Name", CIM_STRING );
+
+    // The first object records the schema and its handles; the second is read through them.
+    const auto objects = query( { .useObjectAccess = true } );
+    ASSERT_EQ( objects.size(), 2u );
+    EXPECT_GT( second.handleReads, 0u );
+    EXPECT_EQ( objects[ 1 ].getProperty< uint32_t >( L"ProcessId" ), 2u );
+    EXPECT_EQ( objects[ 1 ].getProperty< uint32_t >( L"ParentProcessId" ), std::nullopt );
+    EXPECT_EQ( objects[ 1 ].getPropertyView( L"Name" ), std::nullopt );
+    EXPECT_EQ( objects[ 0 ].getProperty< uint32_t >( L"ParentProcessId" ), 0u );
+}
+
+TEST_F(ConversionTest, ObjectAccessKeepsBstrStorage) {
+    addProcess( 1 );
+    auto &second = addProcess( 2 );
+
+    const auto objects = query( { .useObjectAccess = true, .strings = StringStorage::Bstr } );
+    ASSERT_EQ( objects.size(), 2u );
+    for ( const auto &obj: objects ) {
+        EXPECT_NE( obj.getPropertyPtr< utils::BStr >( L"Name" ), nullptr );
+        EXPECT_EQ( obj.getPropertyView( L"Name" ), L"svchost.exe" );
+    }
+    // Numbers still go through the handles.
+    EXPECT_GT( second.handleReads, 0u );
+    EXPECT_EQ( objects[ 1 ].getProperty< uint32_t >( L"ProcessId" ), 2u );
+}
@@ -0,0 +1,439 @@
+// In-process stand-ins for the WMI interfaces, so results can be built without the WMI service.
+// A client wrapping fakes::Services runs its queries against the objects the test put there.
+#pragma once
+#include "wmi.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+#include <cwchar>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace fakes {
+    using SimplerWMI::utils::ComPtr;
+
+    template< typename T > struct IsVector : std::false_type {};
+    template< typename T > struct IsVector< std::vector< T > > : std::true_type {};
+
+    // VARIANT type WMI hands out for a CIM type; 64-bit integers come as decimal strings.
+    inline VARTYPE variantType(const CIMTYPE baseType) {
+        switch ( baseType ) {
+        case CIM_BOOLEAN: return VT_BOOL;
+        case CIM_SINT8: case CIM_SINT16: case CIM_CHAR16: return VT_I2;
+        case CIM_UINT8: return VT_UI1;
+        case CIM_UINT16: case CIM_SINT32: case CIM_UINT32: return VT_I4;
+        case CIM_REAL32: return VT_R4;
+        case CIM_REAL64: return VT_R8;
+        default: return VT_BSTR;
+        }
+    }
+
+    template< typename T >
+    void writeScalar(VARIANT &v, const CIMTYPE baseType, const T &value) {
+        const auto writeString = [&] (const std::wstring_view str) {
+            v.vt = VT_BSTR;
+            v.bstrVal = SysAllocStringLen( str.data(), static_cast< UINT >( str.size() ) );
+        };
+
+        if constexpr ( std::is_convertible_v< const T &, std::wstring_view > ) { writeString( value ); }
+        else {
+            v.vt = variantType( baseType );
+            switch ( v.vt ) {
+            case VT_BOOL: v.boolVal = value ? VARIANT_TRUE : VARIANT_FALSE; break;
+            case VT_I2: v.iVal = static_cast< SHORT >( value ); break;
+            case VT_UI1: v.bVal = static_cast< BYTE >( value ); break;
+            case VT_I4: v.lVal = static_cast< LONG >( value ); break;
+            case VT_R4: v.fltVal = static_cast< float >( value ); break;
+            case VT_R8: v.dblVal = static_cast< double >( value ); break;
+            default:
+                writeString( baseType == CIM_SINT64 ? std::to_wstring( static_cast< int64_t >( value ) )
+                                                    : std::to_wstring( static_cast< uint64_t >( value ) ) );
+            }
+        }
+    }
+
+    // Writes `value` the way WMI hands out a property of `type`, written independently of the
+    // library's own conversions so the tests do not check them against themselves.
+    template< typename T >
+    void writeValue(VARIANT &v, const CIMTYPE type, const T &value) {
+        if constexpr ( IsVector< T >::value ) {
+            const CIMTYPE baseType = type & ~CIM_FLAG_ARRAY;
+            const VARTYPE vt = variantType( baseType );
+            SAFEARRAY *sa = SafeArrayCreateVector( vt, 0, static_cast< ULONG >( value.size() ) );
+            for ( LONG i = 0; i < static_cast< LONG >( value.size() ); ++i ) {
+                SimplerWMI::utils::Variant element;
+                writeScalar( element.get(), baseType, static_cast< typename T::value_type >( value[ i ] ) );
+                // SafeArrayPutElement copies the string a BSTR points to, and other values from their address.
+                void *data = vt == VT_BSTR ? static_cast< void * >( element.get().bstrVal ) : static_cast< void * >( &element.get().bVal );
+                SafeArrayPutElement( sa, &i, data );
+            }
+            v.vt = static_cast< VARTYPE >( VT_ARRAY | vt );
+            v.parray = sa;
+        }
+        else { writeScalar( v, type, value ); }
+    }
+
+    // `base` names the interface `Interface` derives from, if it can be asked for as well.
+    template< typename Interface >
+    class Unknown : public Interface {
+    public:
+        explicit Unknown(const IID &iid, const IID &base = IID_IUnknown) : iid( iid ), base( base ) {}
+        Unknown(const Unknown &) = delete;
+        Unknown &operator=(const Unknown &) = delete;
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **object) override {
+            if ( !IsEqualIID( riid, IID_IUnknown ) && !IsEqualIID( riid, iid ) && !IsEqualIID( riid, base ) ) {
+                *object = nullptr;
+                return E_NOINTERFACE;
+            }
+            *object = static_cast< Interface * >( this );
+            AddRef();
+            return S_OK;
+        }
+        ULONG STDMETHODCALLTYPE AddRef() override { return ++refs; }
+        ULONG STDMETHODCALLTYPE Release() override {
+            const ULONG left = --refs;
+            if ( left == 0 ) { delete this; }
+            return left;
+        }
+
+    protected:
+        virtual ~Unknown() = default;
+
+    private:
+        const IID &iid;
+        const IID &base;
+        std::atomic< ULONG > refs = 1;
+    };
+
+    // Takes over the reference a fake is created with.
+    template< typename T, typename... Args >
+    ComPtr< T > make(Args &&...args) {
+        ComPtr< T > ptr;
+        *ptr.put() = new T( std::forward< Args >( args )... );
+        return ptr;
+    }
+
+    // A class instance with a fixed set of properties, enumerated in the order they were set. Its
+    // IWbemObjectAccess handles are property positions, read from the stored VARIANTs.
+    class Object : public Unknown< IWbemObjectAccess > {
+    public:
+        explicit Object(const std::wstring &className) : Unknown( IID_IWbemObjectAccess, IID_IWbemClassObject ) {
+            setSystem( L"__CLASS", className );
+        }
+
+        template< typename T >
+        Object &set(const std::wstring &name, const CIMTYPE type, const T &value) {
+            Property &prop = slot( name, type, 0 );
+            writeValue( prop.value.get(), type, value );
+            return *this;
+        }
+
+        Object &setNull(const std::wstring &name, const CIMTYPE type) {
+            slot( name, type, 0 ).value.get().vt = VT_NULL;
+            return *this;
+        }
+
+        // An embedded object, such as the TargetInstance of an event.
+        Object &setObject(const std::wstring &name, IUnknown *object) {
+            VARIANT &value = slot( name, CIM_OBJECT, 0 ).value.get();
+            value.vt = VT_UNKNOWN;
+            value.punkVal = object;
+            object->AddRef();
+            return *this;
+        }
+
+        Object &setSystem(const std::wstring &name, const std::wstring &value) {
+            Property &prop = slot( name, CIM_STRING, WBEM_FLAVOR_ORIGIN_SYSTEM );
+            writeValue( prop.value.get(), CIM_STRING, value );
+            return *this;
+        }
+
+        // Makes Get of the property fail with `hr`, as a provider that loses an instance would;
+        // S_OK lets it succeed again. Enumeration still reads it.
+        Object &failGet(const std::wstring &name, const HRESULT hr) {
+            for ( auto &prop: properties ) {
+                if ( prop.name == name ) { prop.failure = hr; }
+            }
+            return *this;
+        }
+
+        HRESULT STDMETHODCALLTYPE Get(LPCWSTR name, long, VARIANT *value, CIMTYPE *type, long *flavor) override {
+            for ( auto &prop: properties ) {
+                if ( prop.name != name ) continue;
+                if ( FAILED( prop.failure ) ) return prop.failure;
+                return read( prop, nullptr, value, type, flavor );
+            }
+            return WBEM_E_NOT_FOUND;
+        }
+
+        HRESULT STDMETHODCALLTYPE BeginEnumeration(long) override {
+            position = 0;
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE Next(long, BSTR *name, VARIANT *value, CIMTYPE *type, long *flavor) override {
+            if ( position >= properties.size() ) return WBEM_S_NO_MORE_DATA;
+            return read( properties[ position++ ], name, value, type, flavor );
+        }
+
+        HRESULT STDMETHODCALLTYPE EndEnumeration() override { return S_OK; }
+
+        HRESULT STDMETHODCALLTYPE GetQualifierSet(IWbemQualifierSet **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Put(LPCWSTR, long, VARIANT *, CIMTYPE) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Delete(LPCWSTR) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetNames(LPCWSTR, long, VARIANT *, SAFEARRAY **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetPropertyQualifierSet(LPCWSTR, IWbemQualifierSet **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Clone(IWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetObjectText(long, BSTR *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SpawnDerivedClass(long, IWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SpawnInstance(long, IWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CompareTo(long, IWbemClassObject *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetPropertyOrigin(LPCWSTR, BSTR *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE InheritsFrom(LPCWSTR) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetMethod(LPCWSTR, long, IWbemClassObject **, IWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE PutMethod(LPCWSTR, long, IWbemClassObject *, IWbemClassObject *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE DeleteMethod(LPCWSTR) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE BeginMethodEnumeration(long) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE NextMethod(long, BSTR *, IWbemClassObject **, IWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE EndMethodEnumeration() override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetMethodQualifierSet(LPCWSTR, IWbemQualifierSet **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetMethodOrigin(LPCWSTR, BSTR *) override { return E_NOTIMPL; }
+
+        HRESULT STDMETHODCALLTYPE GetPropertyHandle(LPCWSTR name, CIMTYPE *type, long *handle) override {
+            for ( std::size_t i = 0; i < properties.size(); ++i ) {
+                if ( properties[ i ].name != name ) continue;
+                if ( type ) { *type = properties[ i ].type; }
+                *handle = static_cast< long >( i );
+                return S_OK;
+            }
+            return WBEM_E_NOT_FOUND;
+        }
+
+        // Strings are copied with their terminating null and anything else as the first bytes of the
+        // VARIANT's value; a NULL property reads as WBEM_S_FALSE, as with WMI.
+        HRESULT STDMETHODCALLTYPE ReadPropertyValue(long handle, long size, long *read, BYTE *data) override {
+            const VARIANT *value = at( handle );
+            if ( !value ) return WBEM_E_INVALID_PARAMETER;
+            ++handleReads;
+            *read = 0;
+            if ( value->vt == VT_NULL ) return WBEM_S_FALSE;
+            if ( value->vt == VT_BSTR ) {
+                *read = static_cast< long >( ( SysStringLen( value->bstrVal ) + 1 ) * sizeof( wchar_t ) );
+                if ( size < *read ) return WBEM_E_BUFFER_TOO_SMALL;
+                memcpy( data, value->bstrVal, static_cast< std::size_t >( *read ) );
+                return S_OK;
+            }
+            *read = sizeof( uint32_t );
+            if ( size < *read ) return WBEM_E_BUFFER_TOO_SMALL;
+            memcpy( data, &value->lVal, sizeof( uint32_t ) );
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE ReadDWORD(long handle, DWORD *out) override {
+            const VARIANT *value = at( handle );
+            if ( !value ) return WBEM_E_INVALID_PARAMETER;
+            ++handleReads;
+            if ( value->vt == VT_NULL ) return WBEM_S_FALSE;
+            *out = value->ulVal;
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE ReadQWORD(long handle, uint64_t *out) override {
+            const VARIANT *value = at( handle );
+            if ( !value ) return WBEM_E_INVALID_PARAMETER;
+            ++handleReads;
+            if ( value->vt == VT_NULL ) return WBEM_S_FALSE;
+            // 64-bit integers are stored as decimal strings, as WMI hands them out.
+            *out = value->vt == VT_BSTR ? std::wcstoull( value->bstrVal, nullptr, 10 ) : value->ullVal;
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE WritePropertyValue(long, long, const BYTE *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE WriteDWORD(long, DWORD) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE WriteQWORD(long, uint64_t) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetPropertyInfoByHandle(long, BSTR *, CIMTYPE *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Lock(long) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Unlock(long) override { return E_NOTIMPL; }
+
+        // Reads made through handles rather than Get or Next.
+        std::size_t handleReads = 0;
+
+    private:
+        struct Property {
+            std::wstring name;
+            CIMTYPE type = CIM_EMPTY;
+            long flavor = 0;
+            SimplerWMI::utils::Variant value;
+            HRESULT failure = S_OK;
+        };
+
+        Property &slot(const std::wstring &name, const CIMTYPE type, const long flavor) {
+            for ( auto &prop: properties ) {
+                if ( prop.name == name ) {
+                    VariantClear( &prop.value.get() );
+                    prop.type = type;
+                    prop.flavor = flavor;
+                    return prop;
+                }
+            }
+            Property &prop = properties.emplace_back();
+            prop.name = name;
+            prop.type = type;
+            prop.flavor = flavor;
+            return prop;
+        }
+
+        static HRESULT read(Property &prop, BSTR *name, VARIANT *value, CIMTYPE *type, long *flavor) {
+            if ( value ) {
+                VariantInit( value );
+                const HRESULT hr = VariantCopy( value, &prop.value.get() );
+                if ( FAILED( hr ) ) return hr;
+            }
+            if ( name ) { *name = SysAllocStringLen( prop.name.c_str(), static_cast< UINT >( prop.name.size() ) ); }
+            if ( type ) { *type = prop.type; }
+            if ( flavor ) { *flavor = prop.flavor; }
+            return S_OK;
+        }
+
+        VARIANT *at(const long handle) {
+            if ( handle < 0 || static_cast< std::size_t >( handle ) >= properties.size() ) return nullptr;
+            return &properties[ static_cast< std::size_t >( handle ) ].value.get();
+        }
+
+        // A deque, as Variant can be neither copied nor moved.
+        std::deque< Property > properties;
+        std::size_t position = 0;
+    };
+
+    // Hands out `objects`, then ends with `failure` if it is set, as a provider that fails partway does.
+    class Enumerator : public Unknown< IEnumWbemClassObject > {
+    public:
+        explicit Enumerator(std::vector< ComPtr< Object > > objects, const HRESULT failure = S_OK)
+            : Unknown( IID_IEnumWbemClassObject ), objects( std::move( objects ) ), failure( failure ) {}
+
+        HRESULT STDMETHODCALLTYPE Next(long, ULONG count, IWbemClassObject **out, ULONG *returned) override {
+            ULONG handed = 0;
+            for ( ; handed < count && position < objects.size(); ++handed ) {
+                out[ handed ] = objects[ position++ ].get();
+                out[ handed ]->AddRef();
+            }
+            *returned = handed;
+            if ( handed == count ) return S_OK;
+            return FAILED( failure ) ? failure : WBEM_S_FALSE;
+        }
+
+        HRESULT STDMETHODCALLTYPE Reset() override {
+            position = 0;
+            return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE NextAsync(ULONG, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Clone(IEnumWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Skip(long, ULONG) override { return E_NOTIMPL; }
+
+    private:
+        std::vector< ComPtr< Object > > objects;
+        std::size_t position = 0;
+        HRESULT failure;
+    };
+
+    // Answers every ExecQuery with `objects`, or fails it with `failure`; `enumerationFailure` fails
+    // the enumeration after its objects instead. ExecQueryAsync keeps the sink until deliver() hands
+    // it `objects`.
+    class Services : public Unknown< IWbemServices > {
+    public:
+        Services() : Unknown( IID_IWbemServices ) {}
+
+        std::vector< ComPtr< Object > > objects;
+        HRESULT failure = S_OK;
+        HRESULT enumerationFailure = S_OK;
+        std::vector< std::wstring > queries;
+        ComPtr< IWbemObjectSink > sink;
+        std::atomic< int > cancellations = 0;
+
+        Object &add(const std::wstring &className) {
+            objects.push_back( make< Object >( className ) );
+            return *objects.back().get();
+        }
+
+        // Sends `objects` to the last asynchronous query one at a time, then completes it.
+        void deliver() {
+            for ( auto &object : objects ) {
+                IWbemClassObject *one = object.get();
+                sink->Indicate( 1, &one );
+            }
+            sink->SetStatus( WBEM_STATUS_COMPLETE, S_OK, nullptr, nullptr );
+            sink.reset();
+        }
+
+        HRESULT STDMETHODCALLTYPE ExecQuery(const BSTR, const BSTR query, long, IWbemContext *, IEnumWbemClassObject **out) override {
+            queries.emplace_back( query ? query : L"" );
+            if ( FAILED( failure ) ) return failure;
+            *out = new Enumerator( objects, enumerationFailure );
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE OpenNamespace(const BSTR, long, IWbemContext *, IWbemServices **, IWbemCallResult **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CancelAsyncCall(IWbemObjectSink *) override {
+            ++cancellations;
+            return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE QueryObjectSink(long, IWbemObjectSink **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetObject(const BSTR, long, IWbemContext *, IWbemClassObject **, IWbemCallResult **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetObjectAsync(const BSTR, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE PutClass(IWbemClassObject *, long, IWbemContext *, IWbemCallResult **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE PutClassAsync(IWbemClassObject *, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE DeleteClass(const BSTR, long, IWbemContext *, IWbemCallResult **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE DeleteClassAsync(const BSTR, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateClassEnum(const BSTR, long, IWbemContext *, IEnumWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateClassEnumAsync(const BSTR, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE PutInstance(IWbemClassObject *, long, IWbemContext *, IWbemCallResult **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE PutInstanceAsync(IWbemClassObject *, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE DeleteInstance(const BSTR, long, IWbemContext *, IWbemCallResult **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE DeleteInstanceAsync(const BSTR, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateInstanceEnum(const BSTR, long, IWbemContext *, IEnumWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CreateInstanceEnumAsync(const BSTR, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE ExecQueryAsync(const BSTR, const BSTR query, long, IWbemContext *, IWbemObjectSink *out) override {
+            queries.emplace_back( query ? query : L"" );
+            if ( FAILED( failure ) ) return failure;
+            sink = ComPtr< IWbemObjectSink >( out );
+            return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE ExecNotificationQuery(const BSTR, const BSTR, long, IWbemContext *, IEnumWbemClassObject **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE ExecNotificationQueryAsync(const BSTR, const BSTR, long, IWbemContext *, IWbemObjectSink *) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE ExecMethod(const BSTR, const BSTR, long, IWbemContext *, IWbemClassObject *, IWbemClassObject **, IWbemCallResult **) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE ExecMethodAsync(const BSTR, const BSTR, long, IWbemContext *, IWbemClassObject *, IWbemObjectSink *) override { return E_NOTIMPL; }
+    };
+
+    // Fixture of tests that query through a client wrapping fake services. Most of them query
+    // Test_Process objects.
+    class ClientTest : public ::testing::Test {
+    protected:
+        Object &addProcess(const uint32_t id, const std::wstring &name = L"svchost.exe") {
+            return services->add( L"Test_Process" )
+                .set( L"ProcessId", CIM_UINT32, id )
+                .set( L"Name", CIM_STRING, name );
+        }
+
+        // Replaces the objects with `count` processes, named `prefix` followed by their ProcessId.
+        void setProcesses(const std::wstring &prefix, const int count) {
+            services->objects.clear();
+            for ( int i = 0; i < count; ++i ) { addProcess( static_cast< uint32_t >( i ), prefix + std::to_wstring( i ) ); }
+        }
+
+        static std::vector< std::wstring > namesOf(std::span< const SimplerWMI::WindowsManagementInstrumentationObject > objects) {
+            std::vector< std::wstring > names;
+            for ( const auto &obj: objects ) { names.push_back( obj.getProperty< std::wstring >( L"Name" ).value_or( L"" ) ); }
+            return names;
+        }
+
+        ComPtr< Services > services = make< Services >();
+        SimplerWMI::WindowsManagementInstrumentationClient client{ services.get() };
+    };
+}
@@ -0,0 +1,50 @@
+// Credentials handed to proxy blankets: one identity per account and password, kept while anyone holds it.
+#include "wmi.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    std::wstring_view passwordOf(const utils::Credentials &credentials) {
+        const COAUTHIDENTITY &identity = credentials->identity;
+        return { reinterpret_cast< const wchar_t * >( identity.Password ), identity.PasswordLength };
+    }
+}
+
+TEST(AuthIdentity, LeavesTheCurrentUserAlone) {
+    EXPECT_EQ( utils::authIdentity( L"", L"ignored" ), nullptr );
+}
+
+TEST(AuthIdentity, SplitsDomainAccounts) {
+    const utils::Credentials credentials = utils::authIdentity( L"CONTOSO\\operator", L"first" );
+    ASSERT_NE( credentials, nullptr );
+    const COAUTHIDENTITY &identity = credentials->identity;
+    EXPECT_EQ( std::wstring_view( reinterpret_cast< const wchar_t * >( identity.Domain ), identity.DomainLength ), L"CONTOSO" );
+    EXPECT_EQ( std::wstring_view( reinterpret_cast< const wchar_t * >( identity.User ), identity.UserLength ), L"operator" );
+    EXPECT_EQ( passwordOf( credentials ), L"first" );
+}
+
+TEST(AuthIdentity, KeepsEveryPasswordOfAnAccountInUse) {
+    const utils::Credentials first = utils::authIdentity( L"rotating@contoso.com", L"first secret" );
+    EXPECT_EQ( utils::authIdentity( L"rotating@contoso.com", L"first secret" ), first );
+
+    const utils::Credentials second = utils::authIdentity( L"rotating@contoso.com", L"second secret" );
+    ASSERT_NE( second, first );
+    EXPECT_NE( second->generation, first->generation );
+    EXPECT_EQ( passwordOf( second ), L"second secret" );
+
+    // A client that still uses the old password keeps it intact, and both stay interned.
+    EXPECT_EQ( passwordOf( first ), L"first secret" );
+    EXPECT_EQ( utils::authIdentity( L"rotating@contoso.com", L"first secret" ), first );
+    EXPECT_EQ( utils::authIdentity( L"rotating@contoso.com", L"second secret" ), second );
+}
+
+TEST(AuthIdentity, ForgetsIdentitiesNobodyHolds) {
+    uint64_t released = 0;
+    {
+        const utils::Credentials credentials = utils::authIdentity( L"expired@contoso.com", L"secret" );
+        released = credentials->generation;
+    }
+    EXPECT_NE( utils::authIdentity( L"expired@contoso.com", L"secret" )->generation, released );
+}
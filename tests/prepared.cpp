@@ -0,0 +1,44 @@
+// Prepared queries keep their last good objects and can be stored like any other value.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <vector>
+
+using namespace SimplerWMI;
+
+namespace {
+    class PreparedQueryTest : public fakes::ClientTest {};
+}
+
+TEST_F(PreparedQueryTest, FailedRunsKeepThePreviousObjects) {
+    setProcesses( L"first ", 2 );
+    // One object per Next, so both are refilled before the call that fails.
+    PreparedQuery query = client.prepare( Query( L"Test_Process" ).select( { L"Name", L"ProcessId" } ), { .batchSize = 1 } );
+    ASSERT_TRUE( query.tryExecute().has_value() );
+
+    setProcesses( L"second ", 2 );
+    services->enumerationFailure = WBEM_E_PROVIDER_FAILURE;
+    const auto failed = query.tryExecute();
+    ASSERT_FALSE( failed.has_value() );
+    EXPECT_EQ( failed.error(), WBEM_E_PROVIDER_FAILURE );
+    EXPECT_EQ( namesOf( query.objects() ), ( std::vector< std::wstring >{ L"first 0", L"first 1" } ) );
+
+    services->enumerationFailure = S_OK;
+    EXPECT_EQ( namesOf( query.execute() ), ( std::vector< std::wstring >{ L"second 0", L"second 1" } ) );
+}
+
+TEST_F(PreparedQueryTest, CanBeStoredAndReassigned) {
+    setProcesses( L"process ", 3 );
+    std::vector< PreparedQuery > queries;
+    queries.push_back( client.prepare( Query( L"Test_Process" ) ) );
+    queries.push_back( client.prepare( Query( L"Test_Process" ).select( { L"Name" } ) ) );
+    queries.front().execute();
+
+    std::optional< PreparedQuery > held;
+    held = std::move( queries.front() );
+    held = std::move( queries.back() );
+    EXPECT_EQ( held->execute().size(), 3u );
+    EXPECT_EQ( namesOf( held->execute() ), ( std::vector< std::wstring >{ L"process 0", L"process 1", L"process 2" } ) );
+}
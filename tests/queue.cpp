@@ -0,0 +1,147 @@
+// The lock-free ring buffer behind event subscriptions and the backpressure policies built on it.
+#include "wmi.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace SimplerWMI;
+using namespace std::chrono_literals;
+
+TEST(BoundedQueue, IsFifoAndRoundsUpItsCapacity) {
+    utils::BoundedQueue< int > queue( 3 );
+    for ( int i = 0; i < 4; ++i ) { EXPECT_TRUE( queue.tryPush( int( i ) ) ); }
+
+    int rejected = 4;
+    EXPECT_FALSE( queue.tryPush( std::move( rejected ) ) );
+    for ( int i = 0; i < 4; ++i ) { EXPECT_EQ( queue.tryPop(), i ); }
+    EXPECT_EQ( queue.tryPop(), std::nullopt );
+}
+
+TEST(BoundedQueue, LeavesARejectedItemUntouched) {
+    utils::BoundedQueue< std::unique_ptr< int > > queue( 2 );
+    EXPECT_TRUE( queue.tryPush( std::make_unique< int >( 1 ) ) );
+    EXPECT_TRUE( queue.tryPush( std::make_unique< int >( 2 ) ) );
+
+    auto item = std::make_unique< int >( 3 );
+    EXPECT_FALSE( queue.tryPush( std::move( item ) ) );
+    ASSERT_NE( item, nullptr );
+    EXPECT_EQ( *item, 3 );
+}
+
+TEST(BoundedQueue, DeliversEveryItemOnceAcrossThreads) {
+    constexpr int producers = 4;
+    constexpr int perProducer = 20000;
+    utils::BoundedQueue< int > queue( 64 );
+    std::atomic< long long > sum = 0;
+    std::atomic< int > popped = 0;
+
+    std::vector< std::thread > threads;
+    for ( int p = 0; p < producers; ++p ) {
+        threads.emplace_back( [&, p] {
+            for ( int i = 1; i <= perProducer; ++i ) {
+                int value = p * perProducer + i;
+                while ( !queue.tryPush( std::move( value ) ) ) { std::this_thread::yield(); }
+            }
+        } );
+    }
+    for ( int c = 0; c < 2; ++c ) {
+        threads.emplace_back( [&] {
+            while ( popped.load() < producers * perProducer ) {
+                if ( const auto value = queue.tryPop() ) {
+                    sum += *value;
+                    ++popped;
+                }
+                else { std::this_thread::yield(); }
+            }
+        } );
+    }
+    for ( auto &thread: threads ) { thread.join(); }
+
+    const long long n = producers * perProducer;
+    EXPECT_EQ( popped.load(), n );
+    EXPECT_EQ( sum.load(), n * ( n + 1 ) / 2 );
+}
+
+TEST(Channel, DropNewestDiscardsTheIncomingItem) {
+    utils::Channel< int > channel( 2, Backpressure::DropNewest );
+    EXPECT_TRUE( channel.push( 1 ) );
+    EXPECT_TRUE( channel.push( 2 ) );
+    EXPECT_FALSE( channel.push( 3 ) );
+    EXPECT_EQ( channel.dropped(), 1u );
+
+    std::vector< int > items;
+    EXPECT_EQ( channel.pop( items, 8, 0ms ), 2u );
+    EXPECT_EQ( items, ( std::vector< int >{ 1, 2 } ) );
+}
+
+TEST(Channel, DropOldestMakesRoom) {
+    utils::Channel< int > channel( 2, Backpressure::DropOldest );
+    EXPECT_TRUE( channel.push( 1 ) );
+    EXPECT_TRUE( channel.push( 2 ) );
+    EXPECT_FALSE( channel.push( 3 ) );
+    EXPECT_FALSE( channel.push( 4 ) );
+    EXPECT_EQ( channel.dropped(), 2u );
+
+    EXPECT_EQ( channel.pop( 0ms ), 3 );
+    EXPECT_EQ( channel.pop( 0ms ), 4 );
+    EXPECT_EQ( channel.pop( 0ms ), std::nullopt );
+}
+
+TEST(Channel, BlockWaitsForRoom) {
+    utils::Channel< int > channel( 2, Backpressure::Block );
+    EXPECT_TRUE( channel.push( 1 ) );
+    EXPECT_TRUE( channel.push( 2 ) );
+
+    std::atomic< bool > pushed = false;
+    std::thread producer( [&] {
+        EXPECT_TRUE( channel.push( 3 ) );
+        pushed = true;
+    } );
+    std::this_thread::sleep_for( 50ms );
+    EXPECT_FALSE( pushed.load() );
+
+    EXPECT_EQ( channel.pop( 1s ), 1 );
+    producer.join();
+    EXPECT_TRUE( pushed.load() );
+    EXPECT_EQ( channel.dropped(), 0u );
+    EXPECT_EQ( channel.pop( 0ms ), 2 );
+    EXPECT_EQ( channel.pop( 0ms ), 3 );
+}
+
+TEST(Channel, CloseReleasesBlockedProducers) {
+    utils::Channel< int > channel( 2, Backpressure::Block );
+    EXPECT_TRUE( channel.push( 1 ) );
+    EXPECT_TRUE( channel.push( 2 ) );
+
+    std::thread producer( [&] { EXPECT_FALSE( channel.push( 3 ) ); } );
+    std::this_thread::sleep_for( 20ms );
+    channel.close();
+    producer.join();
+
+    EXPECT_TRUE( channel.isClosed() );
+    EXPECT_EQ( channel.dropped(), 1u );
+    // Items queued before closing can still be taken.
+    EXPECT_EQ( channel.pop( 0ms ), 1 );
+    EXPECT_EQ( channel.pop( 0ms ), 2 );
+}
+
+TEST(Channel, ClosedChannelRejectsItems) {
+    for ( const auto policy: { Backpressure::Block, Backpressure::DropNewest, Backpressure::DropOldest } ) {
+        utils::Channel< int > channel( 4, policy );
+        EXPECT_TRUE( channel.push( 1 ) );
+        channel.close();
+        EXPECT_FALSE( channel.push( 2 ) );
+        EXPECT_EQ( channel.dropped(), 1u );
+        EXPECT_EQ( channel.pop( 0ms ), 1 );
+        EXPECT_EQ( channel.pop( 0ms ), std::nullopt );
+    }
+}
+
+TEST(Channel, PopTimesOutWhenEmpty) {
+    utils::Channel< int > channel( 4, Backpressure::Block );
+    const auto started = std::chrono::steady_clock::now();
+    EXPECT_EQ( channel.pop( 30ms ), std::nullopt );
+    EXPECT_GE( std::chrono::steady_clock::now() - started, 25ms );
+}
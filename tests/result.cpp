@@ -0,0 +1,46 @@
+// Result and the failures utils::capture turns into one.
+#include "wmi.hpp"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+
+using namespace SimplerWMI;
+
+TEST(Result, HoldsAValue) {
+    Result< std::vector< int > > result( std::vector< int >{ 1, 2, 3 } );
+    ASSERT_TRUE( result );
+    EXPECT_TRUE( result.has_value() );
+    EXPECT_EQ( result.error(), S_OK );
+    EXPECT_EQ( result->size(), 3u );
+    EXPECT_EQ( ( *result )[ 1 ], 2 );
+    EXPECT_EQ( result.value().back(), 3 );
+    EXPECT_EQ( result.value_or( std::vector< int >{} ).size(), 3u );
+
+    const std::vector< int > moved = std::move( result ).value();
+    EXPECT_EQ( moved.size(), 3u );
+}
+
+TEST(Result, HoldsAnHresult) {
+    const auto result = Result< int >::failure( WBEM_E_ACCESS_DENIED );
+    EXPECT_FALSE( result );
+    EXPECT_EQ( result.error(), WBEM_E_ACCESS_DENIED );
+    EXPECT_EQ( result.value_or( 7 ), 7 );
+    EXPECT_EQ( result.operator->(), nullptr );
+
+    try {
+        (void)result.value();
+        FAIL() << "value() of a failure must throw";
+    }
+    catch ( const utils::Exception &e ) { EXPECT_EQ( e.hresult(), WBEM_E_ACCESS_DENIED ); }
+}
+
+TEST(Capture, MapsExceptionsToHresults) {
+    const auto fails = [] (auto thrower) { return utils::capture( [&] () -> Result< int > { thrower(); return 1; } ); };
+
+    EXPECT_EQ( fails( [] { throw utils::Exception( WBEM_E_INVALID_CLASS ); } ).error(), WBEM_E_INVALID_CLASS );
+    EXPECT_EQ( fails( [] { throw utils::Exception( ERROR_INVALID_DATA ); } ).error(), HRESULT_FROM_WIN32( ERROR_INVALID_DATA ) );
+    EXPECT_EQ( fails( [] { throw std::bad_alloc(); } ).error(), E_OUTOFMEMORY );
+    EXPECT_EQ( fails( [] { throw std::runtime_error( "other" ); } ).error(), E_UNEXPECTED );
+    EXPECT_EQ( utils::capture( [] { return Result< int >( 5 ); } ).value(), 5 );
+}
@@ -0,0 +1,55 @@
+// Arena-backed result sets keep their objects and strings valid when they are moved.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    class ResultSetTest : public fakes::ClientTest {
+    protected:
+        ResultSet query(const std::wstring &prefix, const int count) {
+            // Long enough not to fit into a std::wstring's own buffer.
+            setProcesses( prefix + L" process with a long name ", count );
+            return client.getResultSet( L"Test_Process" );
+        }
+
+        static void expectContents(const ResultSet &set, const std::wstring &prefix, const int count) {
+            ASSERT_EQ( set.size(), static_cast< std::size_t >( count ) );
+            for ( int i = 0; i < count; ++i ) {
+                EXPECT_EQ( set[ i ].getPropertyView( L"Name" ), prefix + L" process with a long name " + std::to_wstring( i ) );
+                EXPECT_EQ( set[ i ].getProperty< uint32_t >( L"ProcessId" ), static_cast< uint32_t >( i ) );
+            }
+        }
+    };
+}
+
+TEST_F(ResultSetTest, MoveConstructionKeepsTheArena) {
+    ResultSet source = query( L"first", 16 );
+    const ResultSet moved( std::move( source ) );
+    expectContents( moved, L"first", 16 );
+}
+
+TEST_F(ResultSetTest, MoveAssignmentReplacesANonEmptySet) {
+    ResultSet target = query( L"old", 8 );
+    ResultSet source = query( L"new", 32 );
+    const auto *first = &source[ 0 ];
+
+    target = std::move( source );
+    expectContents( target, L"new", 32 );
+    // The objects themselves moved over, not copies of them.
+    EXPECT_EQ( &target[ 0 ], first );
+
+    target = query( L"again", 4 );
+    expectContents( target, L"again", 4 );
+}
+
+TEST_F(ResultSetTest, MoveAssignmentWithEmptySets) {
+    ResultSet target = query( L"old", 8 );
+    target = ResultSet();
+    EXPECT_TRUE( target.empty() );
+
+    ResultSet empty;
+    empty = query( L"new", 3 );
+    expectContents( empty, L"new", 3 );
+}
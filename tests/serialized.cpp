@@ -0,0 +1,197 @@
+// Binary result encoding: round trips through SerializedResultSet and rejection of corrupt input.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    std::vector< WindowsManagementInstrumentationObject > sampleObjects() {
+        auto services = fakes::make< fakes::Services >();
+        services->add( L"Test_Disk" )
+            .setSystem( L"__RELPATH", L"Test_Disk.Name=\"C:\"" )
+            .set( L"Name", CIM_STRING, L"C:" )
+            .set( L"Size", CIM_UINT64, uint64_t( 512110190592ull ) )
+            .set( L"Removable", CIM_BOOLEAN, false )
+            .set( L"Usage", CIM_REAL64, 0.75 )
+            .set( L"Partitions", CIM_UINT32 | CIM_FLAG_ARRAY, std::vector< uint32_t >{ 1, 2, 3 } )
+            .set( L"Labels", CIM_STRING | CIM_FLAG_ARRAY, std::vector< std::wstring >{ L"System", L"C:" } );
+        services->add( L"Test_Volume" )
+            .set( L"Letter", CIM_CHAR16, L'D' )
+            .set( L"Blocks", CIM_SINT32, -5 );
+        services->add( L"Test_Disk" )
+            .setSystem( L"__RELPATH", L"Test_Disk.Name=\"E:\"" )
+            .set( L"Name", CIM_STRING, L"E:" )
+            .set( L"Size", CIM_UINT64, uint64_t( 0 ) )
+            .set( L"Removable", CIM_BOOLEAN, true )
+            .set( L"Usage", CIM_REAL64, 0.0 )
+            .set( L"Partitions", CIM_UINT32 | CIM_FLAG_ARRAY, std::vector< uint32_t >{} )
+            .set( L"Labels", CIM_STRING | CIM_FLAG_ARRAY, std::vector< std::wstring >{ L"Backup" } );
+
+        WindowsManagementInstrumentationClient client( services.get() );
+        return client.getProperties( L"Test_Object" );
+    }
+
+    bool rejects(const std::vector< std::byte > &buffer) {
+        try {
+            SerializedResultSet set( buffer );
+            for ( const auto object: set ) {
+                for ( const auto &prop: object.schema()->properties() ) {
+                    (void)object.getPropertyView( prop.name );
+                    (void)object.getArray< uint32_t >( prop.name );
+                    (void)object.getArray< bool >( prop.name );
+                    (void)object.getStringArray( prop.name );
+                }
+            }
+            return false;
+        }
+        catch ( const utils::Exception &e ) {
+            EXPECT_EQ( e.hresult(), HRESULT_FROM_WIN32( ERROR_INVALID_DATA ) );
+            return true;
+        }
+    }
+}
+
+TEST(SerializedResultSet, RoundTripsObjectsInOrder) {
+    const auto objects = sampleObjects();
+    ASSERT_EQ( objects.size(), 3u );
+
+    const std::vector< std::byte > buffer = SerializedResultSet::write( objects );
+    const SerializedResultSet set( buffer );
+    ASSERT_EQ( set.size(), 3u );
+
+    const auto c = set[ 0 ];
+    EXPECT_EQ( c.schema()->className(), L"Test_Disk" );
+    EXPECT_EQ( c.getPropertyView( L"Name" ), L"C:" );
+    EXPECT_EQ( c.getProperty< std::wstring >( L"__RELPATH" ), L"Test_Disk.Name=\"C:\"" );
+    EXPECT_EQ( c.getProperty< uint64_t >( L"Size" ), 512110190592ull );
+    EXPECT_EQ( c.getProperty< bool >( L"Removable" ), false );
+    EXPECT_EQ( c.getProperty< double >( L"Usage" ), 0.75 );
+    const auto partitions = c.getArray< uint32_t >( L"Partitions" );
+    EXPECT_EQ( std::vector< uint32_t >( partitions.begin(), partitions.end() ), ( std::vector< uint32_t >{ 1, 2, 3 } ) );
+    EXPECT_EQ( c.getStringArray( L"Labels" ), ( std::vector< std::wstring_view >{ L"System", L"C:" } ) );
+
+    const auto d = set[ 1 ];
+    EXPECT_EQ( d.schema()->className(), L"Test_Volume" );
+    EXPECT_EQ( d.getProperty< wchar_t >( L"Letter" ), L'D' );
+    EXPECT_EQ( d.getProperty< int32_t >( L"Blocks" ), -5 );
+    EXPECT_EQ( d.getPropertyView( L"Name" ), std::nullopt );
+
+    const auto e = set[ 2 ];
+    EXPECT_EQ( e.getPropertyView( L"Name" ), L"E:" );
+    EXPECT_EQ( e.getProperty< bool >( L"Removable" ), true );
+    EXPECT_TRUE( e.getArray< uint32_t >( L"Partitions" ).empty() );
+    EXPECT_EQ( e.getStringArray( L"Labels" ), ( std::vector< std::wstring_view >{ L"Backup" } ) );
+
+    // Wrong types and missing properties read as empty, as they do on the objects themselves.
+    EXPECT_EQ( c.getProperty< uint32_t >( L"Size" ), std::nullopt );
+    EXPECT_TRUE( c.getArray< uint32_t >( L"Missing" ).empty() );
+
+    std::size_t visited = 0;
+    for ( const auto object: set ) {
+        EXPECT_NE( object.schema(), nullptr );
+        ++visited;
+    }
+    EXPECT_EQ( visited, 3u );
+}
+
+TEST(SerializedResultSet, WritesAnEmptySet) {
+    const auto buffer = SerializedResultSet::write( std::span< const WindowsManagementInstrumentationObject >() );
+    const SerializedResultSet set( buffer );
+    EXPECT_TRUE( set.empty() );
+    EXPECT_EQ( set.begin(), set.end() );
+}
+
+TEST(SerializedResultSet, RejectsBadHeaders) {
+    auto buffer = SerializedResultSet::write( sampleObjects() );
+    EXPECT_TRUE( rejects( {} ) );
+
+    auto badMagic = buffer;
+    badMagic[ 0 ] = std::byte{ 'X' };
+    EXPECT_TRUE( rejects( badMagic ) );
+
+    auto badVersion = buffer;
+    badVersion[ 4 ] = std::byte{ 0x7f };
+    EXPECT_TRUE( rejects( badVersion ) );
+}
+
+TEST(SerializedResultSet, RejectsEveryTruncation) {
+    const auto buffer = SerializedResultSet::write( sampleObjects() );
+    for ( std::size_t size = 0; size < buffer.size(); ++size ) {
+        const std::vector< std::byte > truncated( buffer.begin(), buffer.begin() + static_cast< std::ptrdiff_t >( size ) );
+        EXPECT_TRUE( rejects( truncated ) ) << "truncated to " << size << " of " << buffer.size() << " bytes";
+    }
+}
+
+TEST(SerializedResultSet, SurvivesCorruptBytes) {
+    // Flipped bits either go unnoticed in the values or are rejected; they never read out of bounds.
+    const auto buffer = SerializedResultSet::write( sampleObjects() );
+    for ( std::size_t i = 0; i < buffer.size(); ++i ) {
+        for ( const auto flip: { std::byte{ 0x01 }, std::byte{ 0x80 }, std::byte{ 0xff } } ) {
+            auto corrupt = buffer;
+            corrupt[ i ] ^= flip;
+            (void)rejects( corrupt );
+        }
+    }
+}
+
+TEST(SerializedResultSet, KeepsNullsApartFromZeroes) {
+    auto services = fakes::make< fakes::Services >();
+    services->add( L"Test_Disk" )
+        .setNull( L"Name", CIM_STRING )
+        .setNull( L"Size", CIM_UINT64 )
+        .setNull( L"Partitions", CIM_UINT32 | CIM_FLAG_ARRAY )
+        .setNull( L"Labels", CIM_STRING | CIM_FLAG_ARRAY );
+    services->add( L"Test_Disk" )
+        .set( L"Name", CIM_STRING, L"" )
+        .set( L"Size", CIM_UINT64, uint64_t( 0 ) )
+        .set( L"Partitions", CIM_UINT32 | CIM_FLAG_ARRAY, std::vector< uint32_t >{ 7 } )
+        .set( L"Labels", CIM_STRING | CIM_FLAG_ARRAY, std::vector< std::wstring >{ L"Data" } );
+    WindowsManagementInstrumentationClient client( services.get() );
+
+    const std::vector< std::byte > buffer = SerializedResultSet::write( client.getProperties( L"Test_Disk" ) );
+    const SerializedResultSet set( buffer );
+    ASSERT_EQ( set.size(), 2u );
+
+    const auto null = set[ 0 ];
+    EXPECT_EQ( null.getPropertyView( L"Name" ), std::nullopt );
+    EXPECT_EQ( null.getProperty< std::wstring >( L"Name" ), std::nullopt );
+    EXPECT_EQ( null.getProperty< uint64_t >( L"Size" ), std::nullopt );
+    EXPECT_TRUE( null.getArray< uint32_t >( L"Partitions" ).empty() );
+    EXPECT_TRUE( null.getStringArray( L"Labels" ).empty() );
+
+    const auto empty = set[ 1 ];
+    EXPECT_EQ( empty.getPropertyView( L"Name" ), L"" );
+    EXPECT_EQ( empty.getProperty< uint64_t >( L"Size" ), 0u );
+    EXPECT_EQ( empty.getArray< uint32_t >( L"Partitions" ).size(), 1u );
+    EXPECT_EQ( empty.getStringArray( L"Labels" ), ( std::vector< std::wstring_view >{ L"Data" } ) );
+}
+
+TEST(SerializedResultSet, RejectsBooleansOtherThanZeroAndOne) {
+    const std::vector< bool > flags{ true, true, false, true, true, true, false, true };
+    auto services = fakes::make< fakes::Services >();
+    services->add( L"Test_Flags" ).set( L"Flags", CIM_BOOLEAN | CIM_FLAG_ARRAY, flags );
+    WindowsManagementInstrumentationClient client( services.get() );
+    auto buffer = SerializedResultSet::write( client.getProperties( L"Test_Flags" ) );
+
+    // The elements are the only run of these bytes in the buffer.
+    const std::array< std::byte, 8 > elements{
+        std::byte{ 1 }, std::byte{ 1 }, std::byte{ 0 }, std::byte{ 1 }, std::byte{ 1 }, std::byte{ 1 }, std::byte{ 0 }, std::byte{ 1 } };
+    const auto at = std::search( buffer.begin(), buffer.end(), elements.begin(), elements.end() );
+    ASSERT_NE( at, buffer.end() );
+    {
+        const SerializedResultSet set( buffer );
+        const auto read = set[ 0 ].getArray< bool >( L"Flags" );
+        EXPECT_EQ( std::vector< bool >( read.begin(), read.end() ), flags );
+    }
+
+    at[ 2 ] = std::byte{ 2 };
+    const SerializedResultSet set( buffer );
+    try {
+        (void)set[ 0 ].getArray< bool >( L"Flags" );
+        FAIL() << "a corrupt boolean was handed out";
+    }
+    catch ( const utils::Exception &e ) {
+        EXPECT_EQ( e.hresult(), HRESULT_FROM_WIN32( ERROR_INVALID_DATA ) );
+    }
+}
@@ -0,0 +1,161 @@
+// Snapshot diffs between successive results of one query.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+using namespace SimplerWMI;
+
+namespace {
+    class SnapshotTest : public fakes::ClientTest {
+    protected:
+        fakes::Object &addService(const std::wstring &name, const std::wstring &state) {
+            return services->add( L"Test_Service" )
+                .setSystem( L"__RELPATH", L"Test_Service.Name=\"" + name + L"\"" )
+                .set( L"Name", CIM_STRING, name )
+                .set( L"State", CIM_STRING, state )
+                .set( L"ProcessId", CIM_UINT32, 0u );
+        }
+
+        std::vector< WindowsManagementInstrumentationObject > query() const { return client.getProperties( L"Test_Service" ); }
+
+        static std::vector< std::wstring > sortedNamesOf(const std::vector< WindowsManagementInstrumentationObject > &objects) {
+            std::vector< std::wstring > names = namesOf( objects );
+            std::sort( names.begin(), names.end() );
+            return names;
+        }
+    };
+}
+
+TEST_F(SnapshotTest, FirstUpdateAddsEverything) {
+    addService( L"Spooler", L"Running" );
+    addService( L"W32Time", L"Stopped" );
+
+    Snapshot snapshot;
+    const auto delta = snapshot.update( query() );
+    EXPECT_EQ( sortedNamesOf( delta.added ), ( std::vector< std::wstring >{ L"Spooler", L"W32Time" } ) );
+    EXPECT_TRUE( delta.changed.empty() );
+    EXPECT_TRUE( delta.removed.empty() );
+    EXPECT_EQ( snapshot.size(), 2u );
+
+    EXPECT_TRUE( snapshot.update( query() ).empty() );
+}
+
+TEST_F(SnapshotTest, ReportsChangedProperties) {
+    fakes::Object &spooler = addService( L"Spooler", L"Stopped" );
+    addService( L"W32Time", L"Running" );
+
+    Snapshot snapshot;
+    snapshot.update( query() );
+    spooler.set( L"State", CIM_STRING, L"Running" ).set( L"ProcessId", CIM_UINT32, 4242u );
+
+    const auto delta = snapshot.update( query() );
+    ASSERT_EQ( delta.changed.size(), 1u );
+    EXPECT_EQ( delta.changed[ 0 ].object.getPropertyView( L"Name" ), L"Spooler" );
+    auto properties = delta.changed[ 0 ].properties;
+    std::sort( properties.begin(), properties.end() );
+    EXPECT_EQ( properties, ( std::vector< std::wstring >{ L"ProcessId", L"State" } ) );
+    EXPECT_TRUE( delta.added.empty() );
+    EXPECT_TRUE( delta.removed.empty() );
+}
+
+TEST_F(SnapshotTest, ReportsAddedAndRemovedObjects) {
+    addService( L"Spooler", L"Running" );
+    addService( L"W32Time", L"Running" );
+
+    Snapshot snapshot;
+    snapshot.update( query() );
+    services->objects.erase( services->objects.begin() );
+    addService( L"BITS", L"Running" );
+
+    const auto delta = snapshot.update( query() );
+    EXPECT_EQ( sortedNamesOf( delta.added ), ( std::vector< std::wstring >{ L"BITS" } ) );
+    EXPECT_EQ( delta.removed, ( std::vector< std::wstring >{ L"Test_Service.Name=\"Spooler\"" } ) );
+    EXPECT_TRUE( delta.changed.empty() );
+    EXPECT_EQ( snapshot.size(), 2u );
+}
+
+TEST_F(SnapshotTest, IgnoresSystemProperties) {
+    fakes::Object &spooler = addService( L"Spooler", L"Running" );
+
+    Snapshot snapshot( { L"Name" } );
+    snapshot.update( query() );
+    spooler.setSystem( L"__RELPATH", L"Test_Service.Name=\"Renamed\"" );
+    EXPECT_TRUE( snapshot.update( query() ).empty() );
+}
+
+TEST_F(SnapshotTest, KeysOnChosenProperties) {
+    addService( L"Spooler", L"Running" );
+
+    Snapshot snapshot( { L"Name", L"State" } );
+    snapshot.update( query() );
+    services->objects.clear();
+    addService( L"Spooler", L"Stopped" );
+
+    // Another key value is another object.
+    const auto delta = snapshot.update( query() );
+    EXPECT_EQ( delta.added.size(), 1u );
+    EXPECT_EQ( delta.removed.size(), 1u );
+    EXPECT_TRUE( delta.changed.empty() );
+
+    Snapshot missing( { L"NoSuchProperty" } );
+    EXPECT_THROW( missing.update( query() ), utils::Exception );
+}
+
+TEST_F(SnapshotTest, ClearStartsOver) {
+    addService( L"Spooler", L"Running" );
+
+    Snapshot snapshot;
+    snapshot.update( query() );
+    snapshot.clear();
+    EXPECT_EQ( snapshot.size(), 0u );
+    EXPECT_EQ( snapshot.update( query() ).added.size(), 1u );
+}
+
+TEST_F(SnapshotTest, DuplicateKeysFailWithoutChangingTheSnapshot) {
+    addService( L"Spooler", L"Running" );
+    fakes::Object &time = addService( L"W32Time", L"Stopped" );
+
+    Snapshot snapshot( { L"State" } );
+    snapshot.update( query() );
+    time.set( L"State", CIM_STRING, L"Running" );
+
+    try {
+        snapshot.update( query() );
+        FAIL() << "two objects with the same key were accepted";
+    }
+    catch ( const utils::Exception &e ) {
+        EXPECT_EQ( e.hresult(), WBEM_E_INVALID_PARAMETER );
+    }
+    EXPECT_EQ( snapshot.size(), 2u );
+
+    // The next update is still diffed against the last one that succeeded.
+    time.set( L"State", CIM_STRING, L"Stopped" ).set( L"ProcessId", CIM_UINT32, 7u );
+    const auto delta = snapshot.update( query() );
+    ASSERT_EQ( delta.changed.size(), 1u );
+    EXPECT_EQ( delta.changed[ 0 ].properties, ( std::vector< std::wstring >{ L"ProcessId" } ) );
+    EXPECT_TRUE( delta.added.empty() );
+    EXPECT_TRUE( delta.removed.empty() );
+}
+
+TEST_F(SnapshotTest, FailedLazyReadsLeaveTheSnapshotAlone) {
+    fakes::Object &spooler = addService( L"Spooler", L"Stopped" );
+    fakes::Object &time = addService( L"W32Time", L"Running" );
+
+    Snapshot snapshot;
+    snapshot.update( query() );
+    spooler.set( L"State", CIM_STRING, L"Running" );
+    time.set( L"State", CIM_STRING, L"Stopped" ).failGet( L"ProcessId", WBEM_E_NOT_FOUND );
+
+    // Spooler's values are read before W32Time's fail.
+    EXPECT_THROW( snapshot.update( client.getProperties( L"Test_Service", {}, { .lazy = true } ) ), utils::Exception );
+    EXPECT_EQ( snapshot.size(), 2u );
+
+    time.failGet( L"ProcessId", S_OK );
+    const auto delta = snapshot.update( query() );
+    std::vector< std::wstring > changed;
+    for ( const auto &change: delta.changed ) { changed.push_back( std::wstring( *change.object.getPropertyView( L"Name" ) ) ); }
+    std::sort( changed.begin(), changed.end() );
+    EXPECT_EQ( changed, ( std::vector< std::wstring >{ L"Spooler", L"W32Time" } ) );
+}
@@ -0,0 +1,84 @@
+// Columnar results, and the schemas they share with object results.
+#include "fakes.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+namespace {
+    class TableTest : public fakes::ClientTest {
+    protected:
+        void addEvent(const std::wstring &name, const uint32_t id) {
+            auto instance = fakes::make< fakes::Object >( L"Test_Instance" );
+            instance->set( L"Name", CIM_STRING, name );
+            services->add( L"Test_Event" )
+                .set( L"Name", CIM_STRING, name )
+                .setObject( L"TargetInstance", instance.get() )
+                .set( L"Id", CIM_UINT32, id );
+        }
+    };
+}
+
+TEST_F(TableTest, FillsColumnsAndDictionary) {
+    addEvent( L"first", 1 );
+    addEvent( L"second", 2 );
+    addEvent( L"first", 3 );
+
+    const ResultTable table = client.getTable( L"Test_Event" );
+    ASSERT_EQ( table.rows(), 3u );
+
+    const auto ids = table.column< uint32_t >( L"Id" );
+    EXPECT_EQ( std::vector< uint32_t >( ids.begin(), ids.end() ), ( std::vector< uint32_t >{ 1, 2, 3 } ) );
+    const auto names = table.column< std::wstring >( L"Name" );
+    ASSERT_EQ( names.size(), 3u );
+    EXPECT_EQ( table.string( names[ 0 ] ), L"first" );
+    EXPECT_EQ( table.string( names[ 1 ] ), L"second" );
+    EXPECT_EQ( names[ 2 ], names[ 0 ] );
+    EXPECT_EQ( table.column( L"TargetInstance" ), nullptr );
+}
+
+TEST_F(TableTest, SharedSchemaLeavesOutEmbeddedObjects) {
+    addEvent( L"first", 1 );
+    addEvent( L"second", 2 );
+
+    // The table records the class's schema, which the object queries after it reuse.
+    (void)client.getTable( L"Test_Event" );
+    (void)client.getTable( L"Test_Event" );
+
+    const auto objects = client.getProperties( L"Test_Event", {}, { .lazy = true } );
+    ASSERT_EQ( objects.size(), 2u );
+    ASSERT_NE( objects[ 0 ].schema(), nullptr );
+    EXPECT_EQ( objects[ 0 ].schema()->indexOf( L"TargetInstance" ), ClassSchema::npos );
+    EXPECT_NO_THROW( objects[ 0 ].materialize() );
+    EXPECT_EQ( objects[ 1 ].getProperty< uint32_t >( L"Id" ), 2u );
+
+    const auto eager = client.getProperties( L"Test_Event" );
+    EXPECT_EQ( eager[ 0 ].schema(), objects[ 0 ].schema() );
+    EXPECT_EQ( eager[ 1 ].getPropertyView( L"Name" ), L"second" );
+}
+
+TEST_F(TableTest, CachedSchemasOfSeveralClassesShareColumns) {
+    for ( uint32_t i = 0; i < 4; ++i ) {
+        const std::wstring name = L"object " + std::to_wstring( i );
+        if ( i % 2 == 0 ) { services->add( L"Test_First" ).set( L"Name", CIM_STRING, name ).set( L"Id", CIM_UINT32, i ); }
+        else { services->add( L"Test_Second" ).set( L"Id", CIM_STRING, std::to_wstring( i ) ).set( L"Name", CIM_STRING, name ); }
+    }
+
+    // The first table records both schemas; the second one is built through them.
+    (void)client.getTable( L"Test_Base" );
+    const ResultTable table = client.getTable( L"Test_Base" );
+    ASSERT_EQ( table.rows(), 4u );
+
+    const auto names = table.column< std::wstring >( L"Name" );
+    ASSERT_EQ( names.size(), 4u );
+    for ( std::size_t row = 0; row < 4; ++row ) { EXPECT_EQ( table.string( names[ row ] ), L"object " + std::to_wstring( row ) ); }
+
+    // Test_Second's string Id conflicts with the column Test_First created, and is left null.
+    const ResultTable::Column *ids = table.column( L"Id" );
+    ASSERT_NE( ids, nullptr );
+    EXPECT_EQ( ids->type(), CIM_UINT32 );
+    EXPECT_FALSE( ids->isNull( 0 ) );
+    EXPECT_TRUE( ids->isNull( 1 ) );
+    EXPECT_EQ( ids->values< uint32_t >()[ 2 ], 2u );
+    EXPECT_TRUE( ids->isNull( 3 ) );
+}
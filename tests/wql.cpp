@@ -0,0 +1,58 @@
+// WQL literals, LIKE escaping, query building and query normalization.
+#include "wmi.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace SimplerWMI;
+
+TEST(WqlLiteral, Numbers) {
+    EXPECT_EQ( utils::wqlLiteral( 42 ), L"42" );
+    EXPECT_EQ( utils::wqlLiteral( -7ll ), L"-7" );
+    EXPECT_EQ( utils::wqlLiteral( uint64_t( 18446744073709551615ull ) ), L"18446744073709551615" );
+    EXPECT_EQ( utils::wqlLiteral( 0.5 ), L"0.5" );
+    EXPECT_EQ( utils::wqlLiteral( 0.1f ), L"0.10000000149011612" );
+}
+
+TEST(WqlLiteral, Booleans) {
+    EXPECT_EQ( utils::wqlLiteral( true ), L"TRUE" );
+    EXPECT_EQ( utils::wqlLiteral( false ), L"FALSE" );
+}
+
+TEST(WqlLiteral, StringsAreQuotedAndEscaped) {
+    EXPECT_EQ( utils::wqlLiteral( L"notepad.exe" ), L"'notepad.exe'" );
+    EXPECT_EQ( utils::wqlLiteral( std::wstring( L"C:\\Windows" ) ), L"'C:\\\\Windows'" );
+    EXPECT_EQ( utils::wqlLiteral( std::wstring_view( L"it's" ) ), L"'it\\'s'" );
+    EXPECT_EQ( utils::wqlLiteral( L"\"double\"" ), L"'\"double\"'" );
+    EXPECT_EQ( utils::wqlLiteral( L"" ), L"''" );
+}
+
+TEST(LikeEscape, WildcardsMatchLiterally) {
+    EXPECT_EQ( likeEscape( L"100%" ), L"100[%]" );
+    EXPECT_EQ( likeEscape( L"a_b[c]" ), L"a[_]b[[]c]" );
+    EXPECT_EQ( likeEscape( L"plain" ), L"plain" );
+}
+
+TEST(Query, ConditionsAreJoinedAndEscaped) {
+    const Query query = Query( L"Win32_Process" )
+        .select( { L"Name", L"ProcessId" } )
+        .where( Property( L"Name" ).like( likeEscape( L"svc_" ) + L"%" ) || Property( L"ProcessId" ) == 4 )
+        .where( !Property( L"ExecutablePath" ).isNull() );
+    EXPECT_EQ( query.wql(),
+               L"SELECT Name,ProcessId FROM Win32_Process WHERE (Name LIKE 'svc[_]%' OR ProcessId = 4) "
+               L"AND NOT ExecutablePath IS NULL" );
+    EXPECT_EQ( query.projection(), L"SELECT Name,ProcessId FROM Win32_Process" );
+}
+
+TEST(NormalizeWql, CollapsesWhitespaceAndCase) {
+    EXPECT_EQ( utils::normalizeWql( L"  select *\tfrom\r\n  win32_process  " ), L"SELECT * FROM WIN32_PROCESS" );
+    EXPECT_EQ( utils::normalizeWql( L"SELECT * FROM Win32_Process" ), utils::normalizeWql( L"select  *  from win32_process" ) );
+}
+
+TEST(NormalizeWql, KeepsStringLiterals) {
+    EXPECT_EQ( utils::normalizeWql( L"select * from x where Name = 'Two  Spaces'" ),
+               L"SELECT * FROM X WHERE NAME = 'Two  Spaces'" );
+    EXPECT_EQ( utils::normalizeWql( L"where a = \"Mixed Case\"" ), L"WHERE A = \"Mixed Case\"" );
+    // An escaped quote does not end the literal.
+    EXPECT_EQ( utils::normalizeWql( L"where a = 'it\\'s  here' and b" ), L"WHERE A = 'it\\'s  here' AND B" );
+    EXPECT_NE( utils::normalizeWql( L"where a = 'x'" ), utils::normalizeWql( L"where a = 'X'" ) );
+}
@@ -1,13 +1,37 @@
 #pragma once
 
+#include <algorithm>
+#include <map>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
+#include <semaphore>
+#include <shared_mutex>
 #include <span>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <variant>
 #include <system_error>
+#include <tuple>
 #include <functional>
-#include <map>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <windows.h>
 #include <wbemcli.h>
@@ -16,9 +40,63 @@
 
 #define THROW_LAST_IF(expr) if (expr) { throw utils::Exception(GetLastError()); }
 #define THROW_LAST() throw utils::Exception(GetLastError())
+// Throws the HRESULT itself: COM and WMI failures do not set the last error.
+#define THROW_IF_FAILED(expr) if ( const HRESULT failedHr = ( expr ); FAILED( failedHr ) ) { throw utils::Exception( failedHr ); }
+
+// Instrumentation is compiled in with SIMPLERWMI_INSTRUMENTATION; without it the hooks below
+// expand to nothing. Define SIMPLERWMI_TRACELOGGING_PROVIDER as the handle of a provider defined
+// with TRACELOGGING_DEFINE_PROVIDER to have every query written as a TraceLogging event as well.
+#ifdef SIMPLERWMI_INSTRUMENTATION
+#define SIMPLERWMI_TRACE_PHASE(phase) const utils::PhaseTimer phaseTimer( utils::QueryTrace::phase )
+#define SIMPLERWMI_TRACE(call) if ( auto *activeTrace = utils::QueryTrace::current() ) { activeTrace->call; }
+#else
+#define SIMPLERWMI_TRACE_PHASE(phase)
+#define SIMPLERWMI_TRACE(call)
+#endif
+
+#if defined( SIMPLERWMI_INSTRUMENTATION ) && defined( SIMPLERWMI_TRACELOGGING_PROVIDER )
+#include <TraceLoggingProvider.h>
+TRACELOGGING_DECLARE_PROVIDER( SIMPLERWMI_TRACELOGGING_PROVIDER );
+#endif
 
 namespace SimplerWMI {
+namespace utils {
+    // Owning BSTR wrapper; copies allocate a new BSTR.
+    class BStr {
+    public:
+        BStr() = default;
+        BStr(const BStr &other) : str( other.str ? SysAllocStringLen( other.str, SysStringLen( other.str ) ) : nullptr ) {
+            if ( other.str && !str ) throw std::bad_alloc();
+        }
+        BStr(BStr &&other) noexcept : str( std::exchange( other.str, nullptr ) ) {}
+        ~BStr() noexcept { if ( str ) { SysFreeString( str ); } }
+
+        BStr &operator=(BStr other) noexcept {
+            std::swap( str, other.str );
+            return *this;
+        }
+
+        // Takes ownership of `raw`.
+        static BStr attach(BSTR raw) noexcept {
+            BStr result;
+            result.str = raw;
+            return result;
+        }
+
+        [[nodiscard]] BSTR get() const noexcept { return str; }
+        [[nodiscard]] std::wstring_view view() const noexcept {
+            return str ? std::wstring_view( str, SysStringLen( str ) ) : std::wstring_view();
+        }
+
+    private:
+        BSTR str = nullptr;
+    };
+}
+
 using WmiValue = std::variant<
+    // NULL properties, and values not converted yet
+    std::monostate,
+
     // Scalar types
     bool, // CIM_BOOLEAN
     int8_t, // CIM_SINT8
@@ -47,290 +125,5356 @@ using WmiValue = std::variant<
     std::vector< float >,
     std::vector< double >,
     std::vector< wchar_t >,
-    std::vector< std::wstring >
+    std::vector< std::wstring >,
+
+    // CIM_STRING, CIM_DATETIME, CIM_REFERENCE kept as the BSTR returned by WMI (StringStorage::Bstr)
+    utils::BStr,
+    // CIM_STRING, CIM_DATETIME, CIM_REFERENCE copied into a query arena (QueryOptions::arena)
+    std::wstring_view
 >;
 
+enum class StringStorage {
+    // Every string is copied into a std::wstring.
+    Copy,
+    // Scalar strings keep the BSTR handed out by WMI; a std::wstring is only built on request.
+    Bstr
+};
+
 namespace utils {
     class Exception : public std::exception {
     public:
+        // Takes an HRESULT or a Win32 error code.
         explicit Exception(const uint32_t error_code)
-            : message( std::system_category().default_error_condition( error_code ).message() ) {}
+            : message( std::system_category().default_error_condition( error_code ).message() ), error( error_code ) {}
 
         [[nodiscard]] const char *what() const noexcept override { return message.c_str(); }
 
+        // The failure as an HRESULT; Win32 error codes are mapped with HRESULT_FROM_WIN32.
+        [[nodiscard]] HRESULT hresult() const noexcept {
+            return error <= 0xFFFF ? HRESULT_FROM_WIN32( error ) : static_cast< HRESULT >( error );
+        }
+
     private:
         std::string message;
+        uint32_t error;
     };
-}
 
-class WindowsManagementInstrumentationObject;
+    template< typename T >
+    class ComPtr {
+    public:
+        ComPtr() = default;
+        explicit ComPtr(T *raw) noexcept : ptr( raw ) { if ( ptr ) { ptr->AddRef(); } }
+        ComPtr(const ComPtr &other) noexcept : ptr( other.ptr ) { if ( ptr ) { ptr->AddRef(); } }
+        ComPtr(ComPtr &&other) noexcept : ptr( std::exchange( other.ptr, nullptr ) ) {}
+        ~ComPtr() noexcept { reset(); }
 
-class WindowsManagementInstrumentationClient {
-public:
-    WindowsManagementInstrumentationClient() {
-        HRESULT hr = CoInitializeEx( nullptr, COINIT_MULTITHREADED );
-        THROW_LAST_IF( FAILED(hr) );
+        ComPtr &operator=(ComPtr other) noexcept {
+            std::swap( ptr, other.ptr );
+            return *this;
+        }
 
-        hr = CoCreateInstance( CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER,
-                               IID_IWbemLocator, reinterpret_cast< LPVOID * >( &pLoc ) );
-        if ( FAILED( hr ) ) {
-            CoUninitialize();
-            THROW_LAST();
+        void reset() noexcept { if ( ptr ) { std::exchange( ptr, nullptr )->Release(); } }
+        // Hands the reference over to the caller.
+        [[nodiscard]] T *detach() noexcept { return std::exchange( ptr, nullptr ); }
+        [[nodiscard]] T *get() const noexcept { return ptr; }
+        [[nodiscard]] T **put() noexcept {
+            reset();
+            return &ptr;
         }
+        T *operator->() const noexcept { return ptr; }
+        explicit operator bool() const noexcept { return ptr != nullptr; }
 
-        hr = pLoc->ConnectServer( _bstr_t( L"ROOT\\CIMV2" ), nullptr, nullptr, nullptr, 0, nullptr, nullptr, &pSvc );
-        if ( FAILED( hr ) ) {
-            pLoc->Release();
-            CoUninitialize();
-            THROW_LAST();
+    private:
+        T *ptr = nullptr;
+    };
+
+    // Failures after which a WMI proxy is unusable and the connection has to be established again.
+    inline bool isDisconnected(const HRESULT hr) noexcept {
+        return hr == RPC_E_DISCONNECTED || hr == RPC_E_SERVER_DIED || hr == RPC_E_SERVER_DIED_DNE
+            || hr == HRESULT_FROM_WIN32( RPC_S_SERVER_UNAVAILABLE ) || hr == HRESULT_FROM_WIN32( RPC_S_CALL_FAILED )
+            || hr == WBEM_E_TRANSPORT_FAILURE;
+    }
+
+    class Variant {
+    public:
+        Variant() noexcept { VariantInit( &value ); }
+        Variant(const Variant &) = delete;
+        Variant &operator=(const Variant &) = delete;
+        ~Variant() noexcept { VariantClear( &value ); }
+
+        [[nodiscard]] VARIANT &get() noexcept { return value; }
+        [[nodiscard]] VARIANT *put() noexcept {
+            VariantClear( &value );
+            return &value;
         }
 
-        hr = CoSetProxyBlanket(
-            pSvc,
-            RPC_C_AUTHN_WINNT,
-            RPC_C_AUTHZ_NONE,
-            nullptr,
-            RPC_C_AUTHN_LEVEL_CALL,
-            RPC_C_IMP_LEVEL_IMPERSONATE,
-            nullptr,
-            EOAC_NONE
-        );
-        if ( FAILED( hr ) ) {
-            pSvc->Release();
-            pLoc->Release();
-            CoUninitialize();
-            THROW_LAST();
+    private:
+        VARIANT value;
+    };
+
+    // Reusable buffer for the objects returned by a single IEnumWbemClassObject::Next call.
+    template< typename T >
+    class ComBatch {
+    public:
+        explicit ComBatch(const ULONG capacity) : items( capacity > 0 ? capacity : 1, nullptr ) {}
+        ComBatch(const ComBatch &) = delete;
+        ComBatch &operator=(const ComBatch &) = delete;
+        ComBatch(ComBatch &&other) noexcept
+            : items( std::exchange( other.items, {} ) ), returned( std::exchange( other.returned, 0 ) ) {}
+        // The objects this batch held are released with `other`.
+        ComBatch &operator=(ComBatch &&other) noexcept {
+            std::swap( items, other.items );
+            std::swap( returned, other.returned );
+            return *this;
+        }
+        ~ComBatch() noexcept { release(); }
+
+        [[nodiscard]] T **data() noexcept { return items.data(); }
+        [[nodiscard]] ULONG capacity() const noexcept { return static_cast< ULONG >( items.size() ); }
+        [[nodiscard]] ULONG *count() noexcept { return &returned; }
+        [[nodiscard]] std::span< T *const > objects() const noexcept { return { items.data(), returned }; }
+
+        // Releases the held objects and grows the buffer to at least `capacity` entries.
+        void reserve(const ULONG capacity) {
+            release();
+            if ( capacity > items.size() ) { items.resize( capacity, nullptr ); }
+        }
+
+        void release() noexcept {
+            for ( ULONG i = 0; i < returned; ++i ) {
+                if ( items[ i ] ) { std::exchange( items[ i ], nullptr )->Release(); }
+            }
+            returned = 0;
+        }
+
+    private:
+        std::vector< T * > items;
+        ULONG returned = 0;
+    };
+
+    class ArrayLock {
+    public:
+        explicit ArrayLock(SAFEARRAY *sa) : sa( sa ) {
+            const HRESULT hr = SafeArrayLock( sa );
+            if ( FAILED( hr ) ) throw Exception( hr );
+        }
+        ArrayLock(const ArrayLock &) = delete;
+        ArrayLock &operator=(const ArrayLock &) = delete;
+        ~ArrayLock() noexcept { SafeArrayUnlock( sa ); }
+
+    private:
+        SAFEARRAY *sa;
+    };
+
+    // C++ representation of every scalar CIM type and how it is read from a VARIANT.
+    template< CIMTYPE Type >
+    struct CimScalar;
+
+    template<> struct CimScalar< CIM_BOOLEAN > {
+        using type = bool;
+        static type read(const VARIANT &v) { return v.boolVal != VARIANT_FALSE; }
+    };
+    template<> struct CimScalar< CIM_SINT8 > {
+        using type = int8_t;
+        static type read(const VARIANT &v) { return static_cast< type >( v.cVal ); }
+    };
+    template<> struct CimScalar< CIM_UINT8 > {
+        using type = uint8_t;
+        static type read(const VARIANT &v) { return static_cast< type >( v.bVal ); }
+    };
+    template<> struct CimScalar< CIM_SINT16 > {
+        using type = int16_t;
+        static type read(const VARIANT &v) { return static_cast< type >( v.iVal ); }
+    };
+    template<> struct CimScalar< CIM_UINT16 > {
+        using type = uint16_t;
+        static type read(const VARIANT &v) { return static_cast< type >( v.uiVal ); }
+    };
+    template<> struct CimScalar< CIM_SINT32 > {
+        using type = int32_t;
+        static type read(const VARIANT &v) { return static_cast< type >( v.intVal ); }
+    };
+    template<> struct CimScalar< CIM_UINT32 > {
+        using type = uint32_t;
+        static type read(const VARIANT &v) { return static_cast< type >( v.uintVal ); }
+    };
+    // WMI hands out 64-bit integers as decimal strings.
+    template<> struct CimScalar< CIM_SINT64 > {
+        using type = int64_t;
+        static type read(const VARIANT &v) {
+            if ( v.vt == VT_BSTR ) return v.bstrVal ? static_cast< type >( std::wcstoll( v.bstrVal, nullptr, 10 ) ) : 0;
+            return static_cast< type >( v.llVal );
+        }
+    };
+    template<> struct CimScalar< CIM_UINT64 > {
+        using type = uint64_t;
+        static type read(const VARIANT &v) {
+            if ( v.vt == VT_BSTR ) return v.bstrVal ? static_cast< type >( std::wcstoull( v.bstrVal, nullptr, 10 ) ) : 0;
+            return static_cast< type >( v.ullVal );
+        }
+    };
+    template<> struct CimScalar< CIM_REAL32 > {
+        using type = float;
+        static type read(const VARIANT &v) { return v.fltVal; }
+    };
+    template<> struct CimScalar< CIM_REAL64 > {
+        using type = double;
+        static type read(const VARIANT &v) { return v.dblVal; }
+    };
+    template<> struct CimScalar< CIM_CHAR16 > {
+        using type = wchar_t;
+        static type read(const VARIANT &v) { return static_cast< type >( v.uiVal ); }
+    };
+    template<> struct CimScalar< CIM_STRING > {
+        using type = std::wstring;
+        static std::wstring_view read(const VARIANT &v) {
+            if ( v.vt != VT_BSTR || !v.bstrVal ) return {};
+            return { v.bstrVal, SysStringLen( v.bstrVal ) };
+        }
+    };
+    template<> struct CimScalar< CIM_DATETIME > : CimScalar< CIM_STRING > {};
+    template<> struct CimScalar< CIM_REFERENCE > : CimScalar< CIM_STRING > {};
+
+    // Calls f.template operator()< Type >() for the runtime base CIM type, or returns false if it is unsupported.
+    template< typename F >
+    bool visitCimType(const CIMTYPE baseType, F &&f) {
+        switch ( baseType ) {
+        case CIM_BOOLEAN: f.template operator()< CIM_BOOLEAN >(); return true;
+        case CIM_SINT8: f.template operator()< CIM_SINT8 >(); return true;
+        case CIM_UINT8: f.template operator()< CIM_UINT8 >(); return true;
+        case CIM_SINT16: f.template operator()< CIM_SINT16 >(); return true;
+        case CIM_UINT16: f.template operator()< CIM_UINT16 >(); return true;
+        case CIM_SINT32: f.template operator()< CIM_SINT32 >(); return true;
+        case CIM_UINT32: f.template operator()< CIM_UINT32 >(); return true;
+        case CIM_SINT64: f.template operator()< CIM_SINT64 >(); return true;
+        case CIM_UINT64: f.template operator()< CIM_UINT64 >(); return true;
+        case CIM_REAL32: f.template operator()< CIM_REAL32 >(); return true;
+        case CIM_REAL64: f.template operator()< CIM_REAL64 >(); return true;
+        case CIM_CHAR16: f.template operator()< CIM_CHAR16 >(); return true;
+        case CIM_STRING: f.template operator()< CIM_STRING >(); return true;
+        case CIM_DATETIME: f.template operator()< CIM_DATETIME >(); return true;
+        case CIM_REFERENCE: f.template operator()< CIM_REFERENCE >(); return true;
+        default: return false;
         }
     }
 
-    ~WindowsManagementInstrumentationClient() noexcept {
-        if ( pSvc ) { pSvc->Release(); }
-        if ( pLoc ) { pLoc->Release(); }
-        CoUninitialize();
+    // Converts in place: a string already held by `out` keeps its buffer.
+    template< CIMTYPE Type >
+    void convertScalar(VARIANT &v, WmiValue &out) {
+        using T = typename CimScalar< Type >::type;
+        if constexpr ( std::is_same_v< T, std::wstring > ) {
+            const std::wstring_view str = CimScalar< Type >::read( v );
+            if ( auto *current = std::get_if< std::wstring >( &out ) ) { current->assign( str ); }
+            else { out.emplace< std::wstring >( str ); }
+        }
+        else { out = CimScalar< Type >::read( v ); }
     }
 
-    std::vector< WindowsManagementInstrumentationObject > getProperties(
-        const std::wstring &object, const std::initializer_list< std::wstring > &&properties = {}) const;
+    using VariantConverter = void (*)(VARIANT &, WmiValue &);
 
-private:
-    static std::wstring prepQuery(
-        const std::wstring &object, const std::initializer_list< std::wstring > &&properties) {
-        std::wstring query = L"SELECT ";
-        if ( properties.size() > 0 ) {
-            for ( const auto &prop: properties ) { query += prop + L","; }
-            query.pop_back();
-        }
-        else { query += L"*"; }
-        query += L" FROM " + object;
-        return query;
+    // Dense dispatch table indexed by the base CIM type; unsupported types map to nullptr.
+    inline constexpr auto scalarConverters = [] {
+        std::array< VariantConverter, CIM_CHAR16 + 1 > table{};
+        table[ CIM_BOOLEAN ] = &convertScalar< CIM_BOOLEAN >;
+        table[ CIM_SINT8 ] = &convertScalar< CIM_SINT8 >;
+        table[ CIM_UINT8 ] = &convertScalar< CIM_UINT8 >;
+        table[ CIM_SINT16 ] = &convertScalar< CIM_SINT16 >;
+        table[ CIM_UINT16 ] = &convertScalar< CIM_UINT16 >;
+        table[ CIM_SINT32 ] = &convertScalar< CIM_SINT32 >;
+        table[ CIM_UINT32 ] = &convertScalar< CIM_UINT32 >;
+        table[ CIM_SINT64 ] = &convertScalar< CIM_SINT64 >;
+        table[ CIM_UINT64 ] = &convertScalar< CIM_UINT64 >;
+        table[ CIM_REAL32 ] = &convertScalar< CIM_REAL32 >;
+        table[ CIM_REAL64 ] = &convertScalar< CIM_REAL64 >;
+        table[ CIM_CHAR16 ] = &convertScalar< CIM_CHAR16 >;
+        table[ CIM_STRING ] = &convertScalar< CIM_STRING >;
+        table[ CIM_DATETIME ] = &convertScalar< CIM_DATETIME >;
+        table[ CIM_REFERENCE ] = &convertScalar< CIM_REFERENCE >;
+        return table;
+    }();
+
+    inline VariantConverter scalarConverter(const CIMTYPE baseType) noexcept {
+        if ( baseType < 0 || static_cast< std::size_t >( baseType ) >= scalarConverters.size() ) return nullptr;
+        return scalarConverters[ static_cast< std::size_t >( baseType ) ];
     }
 
-    static WmiValue convertVariantToWmiValue(VARIANT &vtProp, CIMTYPE cimType) {
-        using VariantConverter = std::function< WmiValue(VARIANT &) >;
-        static const std::map< CIMTYPE, VariantConverter > cimTypeMap = {
-            { CIM_BOOLEAN, [] (VARIANT &v) { return v.boolVal != VARIANT_FALSE; } },
-            { CIM_SINT8, [] (VARIANT &v) { return static_cast< int8_t >( v.cVal ); } },
-            { CIM_UINT8, [] (VARIANT &v) { return static_cast< uint8_t >( v.bVal ); } },
-            { CIM_SINT16, [] (VARIANT &v) { return static_cast< int16_t >( v.iVal ); } },
-            { CIM_UINT16, [] (VARIANT &v) { return static_cast< uint16_t >( v.uiVal ); } },
-            { CIM_SINT32, [] (VARIANT &v) { return v.intVal; } },
-            { CIM_UINT32, [] (VARIANT &v) { return v.uintVal; } },
-            { CIM_SINT64, [] (VARIANT &v) { return v.llVal; } },
-            { CIM_UINT64, [] (VARIANT &v) { return v.ullVal; } },
-            { CIM_REAL32, [] (VARIANT &v) { return v.fltVal; } },
-            { CIM_REAL64, [] (VARIANT &v) { return v.dblVal; } },
-            { CIM_CHAR16, [] (VARIANT &v) { return static_cast< wchar_t >( v.uiVal ); } },
-            { CIM_STRING, [] (VARIANT &v) { return std::wstring( v.bstrVal ? v.bstrVal : L"" ); } },
-            { CIM_DATETIME, [] (VARIANT &v) { return std::wstring( v.bstrVal ? v.bstrVal : L"" ); } },
-            { CIM_REFERENCE, [] (VARIANT &v) { return std::wstring( v.bstrVal ? v.bstrVal : L"" ); } }
+    // Reads one SAFEARRAY element stored with a wider or narrower VARTYPE than the CIM type.
+    template< typename T >
+    T readArrayElement(const BYTE *element, const VARTYPE elementType) {
+        const auto read = [element]< typename Stored > () {
+            Stored value;
+            memcpy( &value, element, sizeof( Stored ) );
+            return static_cast< T >( value );
         };
 
-        if ( cimType & CIM_FLAG_ARRAY ) {
-            CIMTYPE baseType = cimType & ~CIM_FLAG_ARRAY;
-            auto it = cimTypeMap.find( baseType );
-            if ( it == cimTypeMap.end() ) throw utils::Exception( E_NOTIMPL );
+        switch ( elementType ) {
+        case VT_I1: return read.template operator()< int8_t >();
+        case VT_UI1: return read.template operator()< uint8_t >();
+        case VT_I2:
+        case VT_BOOL: return read.template operator()< int16_t >();
+        case VT_UI2: return read.template operator()< uint16_t >();
+        case VT_I4:
+        case VT_INT: return read.template operator()< int32_t >();
+        case VT_UI4:
+        case VT_UINT: return read.template operator()< uint32_t >();
+        case VT_I8: return read.template operator()< int64_t >();
+        case VT_UI8: return read.template operator()< uint64_t >();
+        case VT_R4: return read.template operator()< float >();
+        case VT_R8: return read.template operator()< double >();
+        default: throw Exception( E_INVALIDARG );
+        }
+    }
+
+    // Converts the whole array at once. Elements whose storage matches the C++ type are copied in
+    // bulk; a vector already held by `out` is reused.
+    inline void convertArray(VARIANT &v, const CIMTYPE baseType, WmiValue &out) {
+        if ( !scalarConverter( baseType ) ) throw Exception( E_NOTIMPL );
+        if ( !( v.vt & VT_ARRAY ) ) throw Exception( E_INVALIDARG );
 
-            if ( !( vtProp.vt & VT_ARRAY ) ) throw utils::Exception( E_INVALIDARG );
+        SAFEARRAY *sa = v.parray;
+        LONG lBound, uBound;
+        SafeArrayGetLBound( sa, 1, &lBound );
+        SafeArrayGetUBound( sa, 1, &uBound );
+        const std::size_t count = uBound >= lBound ? static_cast< std::size_t >( uBound - lBound + 1 ) : 0;
 
-            SAFEARRAY *sa = vtProp.parray;
-            LONG lBound, uBound;
-            SafeArrayGetLBound( sa, 1, &lBound );
-            SafeArrayGetUBound( sa, 1, &uBound );
-            LONG count = uBound - lBound + 1;
+        ArrayLock lock( sa );
+        const auto *data = static_cast< const BYTE * >( sa->pvData );
+        const VARTYPE elementType = v.vt & ~VT_ARRAY;
 
-            SafeArrayLock( sa );
-            void *data = sa->pvData;
+        visitCimType( baseType, [&]< CIMTYPE Type > () {
+            using T = typename CimScalar< Type >::type;
+            auto *existing = std::get_if< std::vector< T > >( &out );
+            auto &vec = existing ? *existing : out.emplace< std::vector< T > >();
+            vec.clear();
 
-            auto processArray = [&]<typename T> (T *arr) {
-                std::vector< std::remove_cvref_t< T > > vec;
-                for ( LONG i = 0; i < count; ++i ) {
+            if constexpr ( std::is_same_v< T, bool > ) {
+                const auto *values = reinterpret_cast< const VARIANT_BOOL * >( data );
+                vec.reserve( count );
+                for ( std::size_t i = 0; i < count; ++i ) { vec.push_back( values[ i ] != VARIANT_FALSE ); }
+            }
+            else if constexpr ( std::is_same_v< T, std::wstring > ) {
+                const auto *values = reinterpret_cast< const BSTR * >( data );
+                vec.reserve( count );
+                for ( std::size_t i = 0; i < count; ++i ) {
+                    vec.emplace_back( values[ i ] ? std::wstring_view( values[ i ], SysStringLen( values[ i ] ) ) : L"" );
+                }
+            }
+            else if ( elementType == VT_BSTR ) {
+                const auto *values = reinterpret_cast< const BSTR * >( data );
+                vec.reserve( count );
+                for ( std::size_t i = 0; i < count; ++i ) {
                     VARIANT elem;
                     VariantInit( &elem );
-                    elem.vt = vtProp.vt & ~VT_ARRAY;
-                    if constexpr ( std::is_same_v< T, BSTR > ) { elem.bstrVal = arr[ i ]; }
-                    else { memcpy( &elem, &arr[ i ], sizeof( T ) ); }
-                    vec.emplace_back( std::get< T >( it->second( elem ) ) );
+                    elem.vt = VT_BSTR;
+                    elem.bstrVal = values[ i ];
+                    vec.push_back( CimScalar< Type >::read( elem ) );
                 }
-                return vec;
-            };
-
-            WmiValue result;
-            switch ( baseType ) {
-            case CIM_BOOLEAN: result = processArray( static_cast< VARIANT_BOOL * >( data ) );
-                break;
-            case CIM_SINT8: result = processArray( static_cast< int8_t * >( data ) );
-                break;
-            case CIM_UINT8: result = processArray( static_cast< uint8_t * >( data ) );
-                break;
-            case CIM_SINT16: result = processArray( static_cast< int16_t * >( data ) );
-                break;
-            case CIM_UINT16: result = processArray( static_cast< uint16_t * >( data ) );
-                break;
-            case CIM_SINT32: result = processArray( static_cast< int32_t * >( data ) );
-                break;
-            case CIM_UINT32: result = processArray( static_cast< uint32_t * >( data ) );
-                break;
-            case CIM_SINT64: result = processArray( static_cast< int64_t * >( data ) );
-                break;
-            case CIM_UINT64: result = processArray( static_cast< uint64_t * >( data ) );
-                break;
-            case CIM_REAL32: result = processArray( static_cast< float * >( data ) );
-                break;
-            case CIM_REAL64: result = processArray( static_cast< double * >( data ) );
-                break;
-            case CIM_CHAR16: result = processArray( static_cast< wchar_t * >( data ) );
-                break;
-            case CIM_STRING:
-            case CIM_DATETIME:
-            case CIM_REFERENCE: {
-                auto bstrArray = static_cast< BSTR * >( data );
-                std::vector< std::wstring > stringVec;
-                stringVec.reserve( count );
-
-                for ( LONG i = 0; i < count; ++i ) { stringVec.emplace_back( bstrArray[ i ] ? bstrArray[ i ] : L"" ); }
-                result = stringVec;
-                break;
             }
-            default: SafeArrayUnlock( sa );
-                throw utils::Exception( E_NOTIMPL );
+            else if ( sa->cbElements == sizeof( T ) ) {
+                vec.resize( count );
+                if ( count > 0 ) { memcpy( vec.data(), data, count * sizeof( T ) ); }
+            }
+            else {
+                vec.reserve( count );
+                for ( std::size_t i = 0; i < count; ++i ) {
+                    vec.push_back( readArrayElement< T >( data + i * sa->cbElements, elementType ) );
+                }
             }
+        } );
+    }
 
-            SafeArrayUnlock( sa );
-            return result;
+    // NULL values, scalar or array, become std::monostate, so they read as missing rather than as zero.
+    inline void convertVariant(VARIANT &v, const CIMTYPE cimType, WmiValue &out) {
+        if ( v.vt == VT_NULL || v.vt == VT_EMPTY ) {
+            out = std::monostate();
+            return;
+        }
+        if ( cimType & CIM_FLAG_ARRAY ) {
+            convertArray( v, cimType & ~CIM_FLAG_ARRAY, out );
+            return;
         }
 
-        if ( auto it = cimTypeMap.find( cimType ); it != cimTypeMap.end() ) { return it->second( vtProp ); }
-        throw utils::Exception( E_NOTIMPL );
+        const VariantConverter convert = scalarConverter( cimType );
+        if ( !convert ) throw Exception( E_NOTIMPL );
+        convert( v, out );
     }
 
-private:
-    IWbemLocator *pLoc = nullptr;
-    IWbemServices *pSvc = nullptr;
-};
+    // Copies a string into the arena; the view stays valid for the arena's lifetime.
+    inline std::wstring_view arenaString(std::pmr::memory_resource *arena, const std::wstring_view str) {
+        if ( str.empty() ) return {};
+        auto *chars = static_cast< wchar_t * >( arena->allocate( ( str.size() + 1 ) * sizeof( wchar_t ), alignof( wchar_t ) ) );
+        memcpy( chars, str.data(), str.size() * sizeof( wchar_t ) );
+        chars[ str.size() ] = L'\0';
+        return { chars, str.size() };
+    }
 
-class WindowsManagementInstrumentationObject {
-public:
+    inline bool isStringType(const CIMTYPE cimType) noexcept {
+        return cimType == CIM_STRING || cimType == CIM_DATETIME || cimType == CIM_REFERENCE;
+    }
+
+    inline void convertVariant(
+        VARIANT &v, const CIMTYPE cimType, WmiValue &out, const StringStorage strings,
+        std::pmr::memory_resource *arena = nullptr) {
+        const bool isString = isStringType( cimType );
+        if ( strings == StringStorage::Bstr && isString && v.vt == VT_BSTR ) {
+            // Steal the BSTR so VariantClear leaves it alone.
+            out = BStr::attach( std::exchange( v.bstrVal, nullptr ) );
+            v.vt = VT_EMPTY;
+            return;
+        }
+        if ( arena && isString && v.vt == VT_BSTR ) {
+            out = arenaString( arena, CimScalar< CIM_STRING >::read( v ) );
+            return;
+        }
+        convertVariant( v, cimType, out );
+    }
+
+    template< typename T >
+    inline constexpr bool isOptional = false;
     template< typename T >
-    std::optional< T > getProperty(const std::wstring &prop) const {
-        const auto it = properties.find( prop );
-        if ( it == properties.end() ) return std::nullopt;
+    inline constexpr bool isOptional< std::optional< T > > = true;
 
-        if ( auto *val = std::get_if< T >( &it->second ) ) { return *val; }
-        return std::nullopt;
+    template< typename T >
+    inline constexpr bool isVector = false;
+    template< typename T >
+    inline constexpr bool isVector< std::vector< T > > = true;
+
+    // Writes a VARIANT straight into a record field of type M. NULL leaves the field untouched, so
+    // optional fields stay empty; arrays must use the C++ element type of their CIM type.
+    template< typename M >
+    void readField(VARIANT &v, const CIMTYPE cimType, M &out) {
+        if ( v.vt == VT_NULL || v.vt == VT_EMPTY ) return;
+
+        if constexpr ( isOptional< M > ) { readField( v, cimType, out.emplace() ); }
+        else if constexpr ( std::is_same_v< M, std::wstring > ) {
+            if ( v.vt != VT_BSTR ) throw Exception( WBEM_E_TYPE_MISMATCH );
+            out.assign( CimScalar< CIM_STRING >::read( v ) );
+        }
+        else if constexpr ( isVector< M > ) {
+            WmiValue value;
+            convertArray( v, cimType & ~CIM_FLAG_ARRAY, value );
+            auto *vec = std::get_if< M >( &value );
+            if ( !vec ) throw Exception( WBEM_E_TYPE_MISMATCH );
+            out = std::move( *vec );
+        }
+        else {
+            static_assert( std::is_arithmetic_v< M >, "record fields must be arithmetic, std::wstring, std::vector or std::optional" );
+            const bool supported = visitCimType( cimType, [&]< CIMTYPE Type > () {
+                if constexpr ( std::is_arithmetic_v< typename CimScalar< Type >::type > ) {
+                    out = static_cast< M >( CimScalar< Type >::read( v ) );
+                }
+                else { throw Exception( WBEM_E_TYPE_MISMATCH ); }
+            } );
+            if ( !supported ) throw Exception( E_NOTIMPL );
+        }
+    }
+
+    // VARIANT type WMI expects for a value of a CIM type; 64-bit integers are passed as strings.
+    inline VARTYPE automationType(const CIMTYPE baseType) {
+        switch ( baseType ) {
+        case CIM_BOOLEAN: return VT_BOOL;
+        case CIM_SINT8: case CIM_SINT16: case CIM_CHAR16: return VT_I2;
+        case CIM_UINT8: return VT_UI1;
+        case CIM_UINT16: case CIM_SINT32: case CIM_UINT32: return VT_I4;
+        case CIM_REAL32: return VT_R4;
+        case CIM_REAL64: return VT_R8;
+        case CIM_SINT64: case CIM_UINT64: case CIM_STRING: case CIM_DATETIME: case CIM_REFERENCE: return VT_BSTR;
+        default: throw Exception( E_NOTIMPL );
+        }
     }
 
     template< typename T >
-    std::span< const T > getArray(const std::wstring &prop) const {
-        const auto it = properties.find( prop );
-        if ( it == properties.end() ) return {};
+    void writeScalar(VARIANT &v, const CIMTYPE baseType, const T &value) {
+        const VARTYPE vt = automationType( baseType );
+        const auto writeString = [&] (const std::wstring_view str) {
+            v.bstrVal = SysAllocStringLen( str.data(), static_cast< UINT >( str.size() ) );
+            if ( !v.bstrVal ) throw std::bad_alloc();
+            v.vt = VT_BSTR;
+        };
 
-        if ( auto *vec = std::get_if< std::vector< T > >( &it->second ) ) { return *vec; }
-        return {};
+        if constexpr ( std::is_convertible_v< const T &, std::wstring_view > ) {
+            if ( vt != VT_BSTR || baseType == CIM_SINT64 || baseType == CIM_UINT64 ) throw Exception( WBEM_E_TYPE_MISMATCH );
+            writeString( value );
+        }
+        else {
+            static_assert( std::is_arithmetic_v< T >, "unsupported parameter type" );
+            switch ( vt ) {
+            case VT_BOOL: v.boolVal = value ? VARIANT_TRUE : VARIANT_FALSE; break;
+            case VT_I2: v.iVal = static_cast< SHORT >( value ); break;
+            case VT_UI1: v.bVal = static_cast< BYTE >( value ); break;
+            case VT_I4: v.lVal = static_cast< LONG >( value ); break;
+            case VT_R4: v.fltVal = static_cast< float >( value ); break;
+            case VT_R8: v.dblVal = static_cast< double >( value ); break;
+            default:
+                if ( baseType == CIM_SINT64 ) { writeString( std::to_wstring( static_cast< int64_t >( value ) ) ); }
+                else if ( baseType == CIM_UINT64 ) { writeString( std::to_wstring( static_cast< uint64_t >( value ) ) ); }
+                else { throw Exception( WBEM_E_TYPE_MISMATCH ); }
+                return;
+            }
+            v.vt = vt;
+        }
     }
 
-private:
-    friend class WindowsManagementInstrumentationClient;
-    void addProperty(const std::wstring &name, const WmiValue &value) { properties[ name ] = value; }
+    // Writes a C++ value as the VARIANT for a property of `cimType`, the inverse of convertVariant.
+    // Arrays are passed as std::vector of any element type the base type accepts.
+    template< typename T >
+    void writeVariant(VARIANT &v, const CIMTYPE cimType, const T &value) {
+        if constexpr ( isVector< T > ) {
+            if ( !( cimType & CIM_FLAG_ARRAY ) ) throw Exception( WBEM_E_TYPE_MISMATCH );
+            const CIMTYPE baseType = cimType & ~CIM_FLAG_ARRAY;
+            const VARTYPE vt = automationType( baseType );
 
-private:
-    std::unordered_map< std::wstring, WmiValue > properties;
-};
+            SAFEARRAY *sa = SafeArrayCreateVector( vt, 0, static_cast< ULONG >( value.size() ) );
+            if ( !sa ) throw std::bad_alloc();
+            // Owned by `v` from here on, so the caller's VariantClear frees it if an element fails.
+            v.vt = static_cast< VARTYPE >( VT_ARRAY | vt );
+            v.parray = sa;
 
-inline std::vector< WindowsManagementInstrumentationObject > WindowsManagementInstrumentationClient::getProperties(
-    const std::wstring &object, const std::initializer_list< std::wstring > &&properties) const {
-    IEnumWbemClassObject *pEnumerator = nullptr;
-    std::vector< WindowsManagementInstrumentationObject > results;
+            for ( LONG i = 0; i < static_cast< LONG >( value.size() ); ++i ) {
+                Variant element;
+                writeScalar( element.get(), baseType, static_cast< typename T::value_type >( value[ i ] ) );
+                // SafeArrayPutElement copies the string a BSTR points to, and other values from their address.
+                void *data = vt == VT_BSTR ? static_cast< void * >( element.get().bstrVal ) : static_cast< void * >( &element.get().bVal );
+                const HRESULT hr = SafeArrayPutElement( sa, &i, data );
+                if ( FAILED( hr ) ) throw Exception( hr );
+            }
+        }
+        else {
+            if ( cimType & CIM_FLAG_ARRAY ) throw Exception( WBEM_E_TYPE_MISMATCH );
+            writeScalar( v, cimType, value );
+        }
+    }
 
-    try {
-        const auto query = prepQuery( object, std::move( properties ) );
+    struct StringHash {
+        using is_transparent = void;
+        std::size_t operator()(const std::wstring_view str) const noexcept { return std::hash< std::wstring_view >{}( str ); }
+    };
 
-        HRESULT hr = pSvc->ExecQuery(
-            _bstr_t( L"WQL" ),
-            _bstr_t( query.c_str() ),
-            WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY,
-            nullptr,
-            &pEnumerator
-        );
-        THROW_LAST_IF( FAILED( hr ) );
+    struct StringEqual {
+        using is_transparent = void;
+        bool operator()(const std::wstring_view lhs, const std::wstring_view rhs) const noexcept { return lhs == rhs; }
+    };
+}
 
-        IWbemClassObject *pclsObj = nullptr;
-        ULONG uReturn = 0;
+#ifdef SIMPLERWMI_INSTRUMENTATION
+// Measurements of one synchronous query, from ExecQuery until the last object was extracted.
+struct QueryStats {
+    std::wstring query;
+    std::chrono::nanoseconds total{ 0 };
+    // From the start of the query until Next returned the first object.
+    std::chrono::nanoseconds firstObject{ 0 };
+    std::chrono::nanoseconds exec{ 0 };
+    // Time blocked in IEnumWbemClassObject::Next.
+    std::chrono::nanoseconds next{ 0 };
+    // Reading properties from the objects through Get, Next or property handles.
+    std::chrono::nanoseconds read{ 0 };
+    // Converting VARIANTs into values.
+    std::chrono::nanoseconds convert{ 0 };
+    std::size_t batches = 0;
+    std::size_t objects = 0;
+    std::size_t properties = 0;
+    // Bytes held by the converted values, their heap storage included. Tables and typed records
+    // only count their properties.
+    std::size_t bytes = 0;
+    bool failed = false;
+};
 
-        while ( true ) {
-            hr = pEnumerator->Next( WBEM_INFINITE, 1, &pclsObj, &uReturn );
-            if ( hr == WBEM_S_FALSE ) break;
-            THROW_LAST_IF( FAILED( hr ) );
-
-            SAFEARRAY *pNames = nullptr;
-            hr = pclsObj->GetNames( nullptr, WBEM_FLAG_ALWAYS, nullptr, &pNames );
-            if ( FAILED( hr ) ) {
-                pclsObj->Release();
-                THROW_LAST();
-            }
-
-            LONG lLower, lUpper;
-            SafeArrayGetLBound( pNames, 1, &lLower );
-            SafeArrayGetUBound( pNames, 1, &lUpper );
-
-            std::vector< std::wstring > propertyNames;
-            for ( LONG i = lLower; i <= lUpper; ++i ) {
-                BSTR bstrName;
-                SafeArrayGetElement( pNames, &i, &bstrName );
-                propertyNames.emplace_back( bstrName );
-                SysFreeString( bstrName );
-            }
-            SafeArrayDestroy( pNames );
+// Receives the stats of every synchronous query of the clients it is set on, on the thread that
+// ran the query.
+class QueryObserver {
+public:
+    virtual ~QueryObserver() = default;
+    virtual void onQuery(const QueryStats &stats) = 0;
+};
+#endif
 
-            WindowsManagementInstrumentationObject currentObj;
-            for ( const auto &propName: propertyNames ) {
-                VARIANT vtProp;
-                VariantInit( &vtProp );
-                CIMTYPE cimType;
-                LONG flFlavor = 0;
+struct QueryOptions {
+    // Number of objects requested from the enumerator per Next call.
+    ULONG batchSize = 64;
+    // Read scalar properties through IWbemObjectAccess handles instead of Get + VARIANT conversion.
+    bool useObjectAccess = false;
+    StringStorage strings = StringStorage::Copy;
+    // Memory resource for the property values and scalar strings of the returned objects. String
+    // values are then stored as std::wstring_view into the resource, which must outlive the objects.
+    std::pmr::memory_resource *arena = nullptr;
+    // Limit for the whole query; the query fails with WBEM_E_TIMED_OUT once it passes. Zero waits forever.
+    std::chrono::milliseconds timeout{ 0 };
+    // Stops the query with WBEM_E_CALL_CANCELLED when a stop is requested.
+    std::stop_token cancellation{};
+    // How long a single Next call may block while a timeout or cancellation token is in effect.
+    std::chrono::milliseconds pollInterval{ 100 };
+    // WBEM_FLAG_DIRECT_READ: ask the provider of the queried class only, not those of its subclasses.
+    bool directRead = false;
+    // WBEM_FLAG_USE_AMENDED_QUALIFIERS: include localized qualifiers in the returned objects.
+    bool amendedQualifiers = false;
+    // Keep each object's IWbemClassObject and convert a property the first time it is read. Such
+    // objects must be materialize()d before they outlive the client or are read from several threads.
+    // Cached, asynchronous and event results are never lazy.
+    bool lazy = false;
+#ifdef SIMPLERWMI_INSTRUMENTATION
+    // Filled in with the stats of each synchronous query run with these options.
+    QueryStats *stats = nullptr;
+#endif
+};
 
-                hr = pclsObj->Get( propName.c_str(), 0, &vtProp, &cimType, &flFlavor );
-                if ( FAILED( hr ) ) {
-                    VariantClear( &vtProp );
-                    pclsObj->Release();
-                    THROW_LAST();
+#ifdef SIMPLERWMI_INSTRUMENTATION
+namespace utils {
+    inline std::size_t heapBytes(const WmiValue &value) noexcept {
+        const auto stringBytes = [] (const std::wstring &str) noexcept -> std::size_t {
+            // Short strings live inside the std::wstring itself.
+            return str.capacity() > std::wstring().capacity() ? ( str.capacity() + 1 ) * sizeof( wchar_t ) : 0;
+        };
+        return std::visit( [&] (const auto &v) noexcept -> std::size_t {
+            using T = std::decay_t< decltype( v ) >;
+            if constexpr ( std::is_same_v< T, std::wstring > ) return stringBytes( v );
+            else if constexpr ( std::is_same_v< T, BStr > ) return v.get() ? ( v.view().size() + 1 ) * sizeof( wchar_t ) + sizeof( UINT ) : 0;
+            else if constexpr ( std::is_same_v< T, std::wstring_view > ) return v.empty() ? 0 : ( v.size() + 1 ) * sizeof( wchar_t );
+            else if constexpr ( std::is_same_v< T, std::vector< bool > > ) return v.capacity() / 8;
+            else if constexpr ( isVector< T > ) {
+                std::size_t bytes = v.capacity() * sizeof( typename T::value_type );
+                if constexpr ( std::is_same_v< typename T::value_type, std::wstring > ) {
+                    for ( const auto &str: v ) { bytes += stringBytes( str ); }
                 }
-
-                currentObj.addProperty( propName, convertVariantToWmiValue( vtProp, cimType ) );
-                VariantClear( &vtProp );
+                return bytes;
             }
-            results.push_back( currentObj );
+            else return 0;
+        }, value );
+    }
+
+    // Collects the stats of the query running on this thread. Extraction code reports to it through
+    // SIMPLERWMI_TRACE, so the stats need not be threaded through every call.
+    class QueryTrace {
+    public:
+        using Clock = std::chrono::steady_clock;
+        enum Phase { Exec, Next, Extract, Convert, PhaseCount };
+
+        QueryTrace(std::wstring query, QueryStats *target, QueryObserver *observer)
+            : target( target ), observer( observer ), previous( std::exchange( active, this ) ),
+              exceptions( std::uncaught_exceptions() ) {
+            stats.query = std::move( query );
+        }
+        QueryTrace(const QueryTrace &) = delete;
+        QueryTrace &operator=(const QueryTrace &) = delete;
+
+        ~QueryTrace() noexcept {
+            active = previous;
+            stats.total = Clock::now() - started;
+            stats.exec = elapsed[ Exec ];
+            stats.next = elapsed[ Next ];
+            // Extraction covers reading and converting; conversions are timed on their own.
+            stats.convert = elapsed[ Convert ];
+            stats.read = elapsed[ Extract ] - elapsed[ Convert ];
+            stats.failed = stats.failed || std::uncaught_exceptions() > exceptions;
+
+#ifdef SIMPLERWMI_TRACELOGGING_PROVIDER
+            TraceLoggingWrite(
+                SIMPLERWMI_TRACELOGGING_PROVIDER, "Query",
+                TraceLoggingWideString( stats.query.c_str(), "Query" ),
+                TraceLoggingInt64( stats.total.count(), "TotalNs" ),
+                TraceLoggingInt64( stats.firstObject.count(), "FirstObjectNs" ),
+                TraceLoggingInt64( stats.exec.count(), "ExecNs" ),
+                TraceLoggingInt64( stats.next.count(), "NextNs" ),
+                TraceLoggingInt64( stats.read.count(), "ReadNs" ),
+                TraceLoggingInt64( stats.convert.count(), "ConvertNs" ),
+                TraceLoggingUInt64( stats.objects, "Objects" ),
+                TraceLoggingUInt64( stats.properties, "Properties" ),
+                TraceLoggingUInt64( stats.bytes, "Bytes" ),
+                TraceLoggingBool( stats.failed, "Failed" ) );
+#endif
+            // Observers must not throw out of a query that may already be unwinding.
+            try { if ( observer ) { observer->onQuery( stats ); } }
+            catch ( ... ) {}
+            if ( target ) { *target = std::move( stats ); }
+        }
+
+        [[nodiscard]] static QueryTrace *current() noexcept { return active; }
+
+        void status(const HRESULT hr) noexcept { if ( FAILED( hr ) ) { stats.failed = true; } }
+
+        void returned(const std::size_t objects) noexcept {
+            ++stats.batches;
+            if ( objects > 0 && stats.objects == 0 ) { stats.firstObject = Clock::now() - started; }
+            stats.objects += objects;
+        }
+
+        void converted(const WmiValue &value) noexcept {
+            ++stats.properties;
+            stats.bytes += sizeof( WmiValue ) + heapBytes( value );
+        }
+
+        // Table columns and record fields, whose storage is not counted in QueryStats::bytes.
+        void converted() noexcept { ++stats.properties; }
+
+        // Nested timers of the same phase, such as a refill falling back to a full build, only
+        // count once.
+        void begin(const Phase phase) noexcept {
+            if ( depth[ phase ]++ == 0 ) { since[ phase ] = Clock::now(); }
+        }
+
+        void end(const Phase phase) noexcept {
+            if ( --depth[ phase ] == 0 ) { elapsed[ phase ] += Clock::now() - since[ phase ]; }
+        }
+
+    private:
+        static inline thread_local QueryTrace *active = nullptr;
+
+        QueryStats stats;
+        QueryStats *target;
+        QueryObserver *observer;
+        QueryTrace *previous;
+        int exceptions;
+        Clock::time_point started = Clock::now();
+        std::array< Clock::time_point, PhaseCount > since{};
+        std::array< Clock::duration, PhaseCount > elapsed{};
+        std::array< int, PhaseCount > depth{};
+    };
 
-            pclsObj->Release();
+    class PhaseTimer {
+    public:
+        explicit PhaseTimer(const QueryTrace::Phase phase) noexcept : trace( QueryTrace::current() ), phase( phase ) {
+            if ( trace ) { trace->begin( phase ); }
         }
+        PhaseTimer(const PhaseTimer &) = delete;
+        PhaseTimer &operator=(const PhaseTimer &) = delete;
+        ~PhaseTimer() noexcept { if ( trace ) { trace->end( phase ); } }
+
+    private:
+        QueryTrace *trace;
+        QueryTrace::Phase phase;
+    };
+}
+#endif
+
+struct PropertySchema {
+    std::wstring name;
+    CIMTYPE type = CIM_EMPTY;
+    LONG flavor = 0;
+    // IWbemObjectAccess handle, or -1 if the property cannot be read through one.
+    long handle = -1;
+};
+
+// Property layout shared by every object of one class returned by one query.
+class ClassSchema {
+public:
+    static constexpr std::size_t npos = static_cast< std::size_t >( -1 );
 
-        if ( FAILED( hr ) ) { THROW_LAST_IF( FAILED( hr ) ); }
+    ClassSchema(std::wstring className, std::vector< PropertySchema > properties)
+        : name( std::move( className ) ), props( std::move( properties ) ) {
+        index.reserve( props.size() );
+        for ( std::size_t i = 0; i < props.size(); ++i ) { index.emplace( props[ i ].name, i ); }
     }
-    catch ( const std::runtime_error &e ) {
-        if ( pEnumerator ) pEnumerator->Release();
-        throw std::runtime_error( e );
+
+    // The index refers to the names in `props`, so schemas are shared rather than copied.
+    ClassSchema(const ClassSchema &) = delete;
+    ClassSchema &operator=(const ClassSchema &) = delete;
+
+    [[nodiscard]] const std::wstring &className() const noexcept { return name; }
+    [[nodiscard]] std::span< const PropertySchema > properties() const noexcept { return props; }
+    [[nodiscard]] std::size_t size() const noexcept { return props.size(); }
+
+    // Position of `property` in properties(), or npos if the class has no such property.
+    [[nodiscard]] std::size_t indexOf(const std::wstring_view property) const {
+        const auto it = index.find( property );
+        return it != index.end() ? it->second : npos;
     }
 
-    if ( pEnumerator ) pEnumerator->Release();
-    return results;
+private:
+    std::wstring name;
+    std::vector< PropertySchema > props;
+    std::unordered_map< std::wstring_view, std::size_t, utils::StringHash, utils::StringEqual > index;
+};
+
+// Process-wide cache of class schemas, keyed by namespace, query projection and class name.
+class SchemaCache {
+public:
+    // Query-local view of the cache that remembers the last schema it resolved.
+    class Scope {
+    public:
+        explicit Scope(std::wstring prefix) : prefix( std::move( prefix ) ) {}
+
+        std::shared_ptr< const ClassSchema > find(std::wstring_view className) {
+            if ( last && last->className() == className ) return last;
+            auto schema = instance().find( prefix + std::wstring( className ) );
+            if ( schema ) { last = schema; }
+            return schema;
+        }
+
+        void store(std::shared_ptr< const ClassSchema > schema) {
+            instance().store( prefix + schema->className(), schema );
+            last = std::move( schema );
+        }
+
+    private:
+        std::wstring prefix;
+        std::shared_ptr< const ClassSchema > last;
+    };
+
+    static SchemaCache &instance() {
+        static SchemaCache cache;
+        return cache;
+    }
+
+    std::shared_ptr< const ClassSchema > find(const std::wstring &key) const {
+        std::shared_lock lock( mutex );
+        const auto it = schemas.find( key );
+        return it != schemas.end() ? it->second : nullptr;
+    }
+
+    void store(std::wstring key, std::shared_ptr< const ClassSchema > schema) {
+        std::unique_lock lock( mutex );
+        schemas.insert_or_assign( std::move( key ), std::move( schema ) );
+    }
+
+    void clear() {
+        std::unique_lock lock( mutex );
+        schemas.clear();
+    }
+
+private:
+    mutable std::shared_mutex mutex;
+    std::unordered_map< std::wstring, std::shared_ptr< const ClassSchema > > schemas;
+};
+
+// Binds a struct to a WMI class. Specialize with the class name and a tuple of field()s:
+//
+//   template<> struct SimplerWMI::WmiRecord< Process > {
+//       static constexpr std::wstring_view className = L"Win32_Process";
+//       static constexpr auto fields = std::make_tuple(
+//           SIMPLERWMI_FIELD( Process, Name ), SimplerWMI::field( L"ProcessId", &Process::pid ) );
+//   };
+template< typename T >
+struct WmiRecord;
+
+template< typename Record, typename Member >
+struct RecordField {
+    // Always null-terminated, as it is passed to IWbemClassObject::Get.
+    std::wstring_view name;
+    Member Record::*member;
+};
+
+template< typename Record, typename Member, std::size_t N >
+constexpr RecordField< Record, Member > field(const wchar_t (&name)[ N ], Member Record::*member) {
+    return { std::wstring_view( name, N - 1 ), member };
+}
+
+// Binds a member to the WMI property of the same name.
+#define SIMPLERWMI_FIELD( Record, Member ) ::SimplerWMI::field( L"" #Member, &Record::Member )
+
+namespace utils {
+    template< typename T >
+    constexpr std::size_t recordQueryLength() {
+        static_assert( std::tuple_size_v< decltype( WmiRecord< T >::fields ) > > 0, "a record needs at least one field" );
+        std::size_t length = std::wstring_view( L"SELECT  FROM " ).size() + WmiRecord< T >::className.size();
+        std::apply( [&] (const auto &...fields) { ( ( length += fields.name.size() + 1 ), ... ); }, WmiRecord< T >::fields );
+        // No comma after the last field.
+        return length - 1;
+    }
 }
+
+// "SELECT <fields> FROM <className>" for a record type, built at compile time.
+template< typename T >
+inline constexpr auto recordQuery = [] {
+    std::array< wchar_t, utils::recordQueryLength< T >() + 1 > query{};
+    std::size_t length = 0;
+    const auto append = [&] (const std::wstring_view str) {
+        for ( const wchar_t c: str ) { query[ length++ ] = c; }
+    };
+
+    append( L"SELECT " );
+    std::apply( [&] (const auto &...fields) {
+        bool first = true;
+        ( ( append( std::exchange( first, false ) ? L"" : L"," ), append( fields.name ) ), ... );
+    }, WmiRecord< T >::fields );
+    append( L" FROM " );
+    append( WmiRecord< T >::className );
+    return query;
+}();
+
+class WindowsManagementInstrumentationObject;
+
+// Property name that remembers its position in the schema of the object it was resolved against,
+// so repeated lookups on objects of the same class skip hashing the name.
+class PropertyKey {
+public:
+    explicit PropertyKey(std::wstring name) : propertyName( std::move( name ) ) {}
+
+    [[nodiscard]] const std::wstring &name() const noexcept { return propertyName; }
+
+private:
+    friend class WindowsManagementInstrumentationObject;
+
+    std::wstring propertyName;
+    std::shared_ptr< const ClassSchema > layout;
+    std::size_t index = 0;
+};
+
+// Value or failure of the non-throwing try* calls, modeled on std::expected. The failure is the
+// HRESULT reported by COM or WMI, e.g. WBEM_E_INVALID_CLASS or WBEM_E_TIMED_OUT.
+template< typename T >
+class Result {
+public:
+    Result(T value) : state( std::in_place_index< 0 >, std::move( value ) ) {}
+
+    static Result failure(const HRESULT hr) noexcept { return Result( std::in_place_index< 1 >, hr ); }
+
+    [[nodiscard]] bool has_value() const noexcept { return state.index() == 0; }
+    explicit operator bool() const noexcept { return has_value(); }
+
+    // S_OK if there is a value.
+    [[nodiscard]] HRESULT error() const noexcept { return has_value() ? S_OK : std::get< 1 >( state ); }
+
+    // Throws the failure as utils::Exception.
+    T &value() & { return check(), std::get< 0 >( state ); }
+    const T &value() const & { return check(), std::get< 0 >( state ); }
+    T &&value() && { return check(), std::get< 0 >( std::move( state ) ); }
+
+    template< typename U >
+    T value_or(U &&fallback) const & { return has_value() ? std::get< 0 >( state ) : static_cast< T >( std::forward< U >( fallback ) ); }
+
+    T &operator*() & noexcept { return *std::get_if< 0 >( &state ); }
+    const T &operator*() const & noexcept { return *std::get_if< 0 >( &state ); }
+    T *operator->() noexcept { return std::get_if< 0 >( &state ); }
+    const T *operator->() const noexcept { return std::get_if< 0 >( &state ); }
+
+private:
+    // Tagged, so Result< long > can tell a value from a failure.
+    Result(std::in_place_index_t< 1 > failed, const HRESULT hr) noexcept : state( failed, hr ) {}
+
+    void check() const { if ( !has_value() ) throw utils::Exception( std::get< 1 >( state ) ); }
+
+    std::variant< T, HRESULT > state;
+};
+
+namespace utils {
+    // Runs `work`, which returns a Result, turning anything it throws into a failed Result.
+    template< typename F >
+    std::invoke_result_t< F & > capture(F &&work) noexcept {
+        using R = std::invoke_result_t< F & >;
+        try { return work(); }
+        catch ( const Exception &e ) { return R::failure( e.hresult() ); }
+        catch ( const _com_error &e ) { return R::failure( e.Error() ); }
+        catch ( const std::bad_alloc & ) { return R::failure( E_OUTOFMEMORY ); }
+        catch ( ... ) { return R::failure( E_UNEXPECTED ); }
+    }
+}
+
+class ResultSet;
+class ResultTable;
+class PreparedQuery;
+class MethodCall;
+class ObjectSink;
+struct Event;
+class EventSubscription;
+class EventSink;
+
+enum class ComThreading {
+    // Every client initializes the multithreaded apartment on its own thread.
+    Managed,
+    // The caller has already initialized COM on the thread, in either apartment type.
+    CallerManaged,
+    // All WMI calls run on one process-wide thread in the multithreaded apartment. Visitors called
+    // during a synchronous query run on that thread as well.
+    Worker
+};
+
+namespace utils {
+    // Process-wide thread in the multithreaded apartment that runs COM work for other threads.
+    class ComWorker {
+    public:
+        // Never destroyed, like ConnectionPool, so the thread outlives every client.
+        static ComWorker &instance() {
+            static auto *worker = new ComWorker();
+            return *worker;
+        }
+
+        // Runs `work` on the worker and waits for it, rethrowing its exception. Work submitted from
+        // the worker itself runs inline.
+        template< typename F >
+        std::invoke_result_t< F & > run(F &&work) {
+            if ( std::this_thread::get_id() == id ) return work();
+
+            std::packaged_task< std::invoke_result_t< F & >() > task( std::ref( work ) );
+            auto result = task.get_future();
+            {
+                std::lock_guard lock( mutex );
+                queue.emplace_back( [&task] { task(); } );
+            }
+            ready.notify_one();
+            return result.get();
+        }
+
+        // Queues `work` on the worker without waiting for it; `work` must not throw.
+        template< typename F >
+        void post(F &&work) {
+            {
+                std::lock_guard lock( mutex );
+                queue.emplace_back( std::forward< F >( work ) );
+            }
+            ready.notify_one();
+        }
+
+    private:
+        ComWorker() {
+            std::thread worker( [this] { loop(); } );
+            id = worker.get_id();
+            worker.detach();
+        }
+
+        void loop() {
+            CoInitializeEx( nullptr, COINIT_MULTITHREADED );
+            while ( true ) {
+                std::function< void() > work;
+                {
+                    std::unique_lock lock( mutex );
+                    ready.wait( lock, [this] { return !queue.empty(); } );
+                    work = std::move( queue.front() );
+                    queue.pop_front();
+                }
+                work();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque< std::function< void() > > queue;
+        std::thread::id id;
+    };
+
+    // Process-wide thread that runs callbacks once their deadlines pass. Used for asynchronous
+    // queries, which have no loop of their own that could check a deadline.
+    class Watchdog {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Ticket {
+            Clock::time_point deadline;
+            uint64_t id = 0;
+        };
+
+        // Never destroyed, like ComWorker.
+        static Watchdog &instance() {
+            static auto *watchdog = new Watchdog();
+            return *watchdog;
+        }
+
+        Ticket watch(const Clock::time_point deadline, std::function< void() > onExpired) {
+            Ticket ticket;
+            {
+                std::lock_guard lock( mutex );
+                ticket = { deadline, ++lastId };
+                entries.emplace( std::pair( ticket.deadline, ticket.id ), std::move( onExpired ) );
+            }
+            changed.notify_one();
+            return ticket;
+        }
+
+        // Drops a deadline that has not passed yet; the callback is destroyed outside the lock.
+        void unwatch(const Ticket &ticket) {
+            std::function< void() > dropped;
+            std::lock_guard lock( mutex );
+            if ( auto node = entries.extract( std::pair( ticket.deadline, ticket.id ) ) ) { dropped = std::move( node.mapped() ); }
+        }
+
+    private:
+        Watchdog() { std::thread( [this] { loop(); } ).detach(); }
+
+        void loop() {
+            // Callbacks cancel calls on MTA proxies, or on proxies taken from the global interface table.
+            CoInitializeEx( nullptr, COINIT_MULTITHREADED );
+            std::unique_lock lock( mutex );
+            while ( true ) {
+                if ( entries.empty() ) {
+                    changed.wait( lock );
+                    continue;
+                }
+                const auto first = entries.begin();
+                if ( Clock::now() < first->first.first ) {
+                    changed.wait_until( lock, first->first.first );
+                    continue;
+                }
+
+                auto expired = std::move( first->second );
+                entries.erase( first );
+                lock.unlock();
+                try { expired(); }
+                catch ( ... ) {}
+                expired = nullptr;
+                lock.lock();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::map< std::pair< Clock::time_point, uint64_t >, std::function< void() > > entries;
+        uint64_t lastId = 0;
+    };
+
+    // Runs `work` in the apartment that proxies created under `threading` belong to.
+    template< typename F >
+    std::invoke_result_t< F & > runIn(const ComThreading threading, F &&work) {
+        if ( threading == ComThreading::Worker ) return ComWorker::instance().run( work );
+        return work();
+    }
+
+    // Registration of a proxy in the global interface table, through which threads of another
+    // apartment get proxies of their own. Proxies of an STA thread cannot be called elsewhere.
+    class GlobalServices {
+    public:
+        explicit GlobalServices(IWbemServices *services) {
+            HRESULT hr = CoCreateInstance( CLSID_StdGlobalInterfaceTable, nullptr, CLSCTX_INPROC_SERVER,
+                                           IID_IGlobalInterfaceTable, reinterpret_cast< LPVOID * >( git.put() ) );
+            THROW_IF_FAILED( hr );
+            hr = git->RegisterInterfaceInGlobal( services, IID_IWbemServices, &cookie );
+            THROW_IF_FAILED( hr );
+        }
+
+        GlobalServices(const GlobalServices &) = delete;
+        GlobalServices &operator=(const GlobalServices &) = delete;
+        ~GlobalServices() noexcept { git->RevokeInterfaceFromGlobal( cookie ); }
+
+        // A proxy for the calling thread, or null if it cannot have one.
+        [[nodiscard]] ComPtr< IWbemServices > get() const {
+            ComPtr< IWbemServices > services;
+            if ( FAILED( git->GetInterfaceFromGlobal( cookie, IID_IWbemServices, reinterpret_cast< void ** >( services.put() ) ) ) ) {
+                services.reset();
+            }
+            return services;
+        }
+
+    private:
+        ComPtr< IGlobalInterfaceTable > git;
+        DWORD cookie = 0;
+    };
+}
+
+// Handle to a query running through IWbemServices::ExecQueryAsync.
+class AsyncQuery {
+public:
+    void wait() const { completion.wait(); }
+
+    template< typename Rep, typename Period >
+    bool waitFor(const std::chrono::duration< Rep, Period > &timeout) const {
+        return completion.wait_for( timeout ) == std::future_status::ready;
+    }
+
+    // Waits for the query and rethrows its failure, if any.
+    void get() const { completion.get(); }
+    void cancel() const;
+
+private:
+    friend class WindowsManagementInstrumentationClient;
+    AsyncQuery(
+        IWbemServices *pSvc, utils::ComPtr< ObjectSink > sink, std::shared_future< void > completion,
+        const ComThreading threading)
+        : pSvc( pSvc ), sink( std::move( sink ) ), completion( std::move( completion ) ), threading( threading ) {}
+
+    utils::ComPtr< IWbemServices > pSvc;
+    utils::ComPtr< ObjectSink > sink;
+    std::shared_future< void > completion;
+    ComThreading threading;
+};
+
+namespace utils {
+    // Query language argument shared by every ExecQuery call.
+    inline const _bstr_t &wqlLanguage() {
+        static const _bstr_t language( L"WQL" );
+        return language;
+    }
+
+    // Quotes a string for WQL, escaping backslashes and quotes.
+    inline std::wstring wqlString(const std::wstring_view text) {
+        std::wstring quoted;
+        quoted.reserve( text.size() + 2 );
+        quoted += L'\'';
+        for ( const wchar_t c: text ) {
+            if ( c == L'\\' || c == L'\'' ) { quoted += L'\\'; }
+            quoted += c;
+        }
+        quoted += L'\'';
+        return quoted;
+    }
+
+    template< typename T >
+    std::wstring wqlLiteral(const T &value) {
+        if constexpr ( std::is_same_v< T, bool > ) { return value ? L"TRUE" : L"FALSE"; }
+        else if constexpr ( std::is_integral_v< T > ) { return std::to_wstring( value ); }
+        else if constexpr ( std::is_floating_point_v< T > ) {
+            // Shortest representation that reads back as the same value.
+            char buffer[ 32 ];
+            const char *end = std::to_chars( buffer, std::end( buffer ), static_cast< double >( value ) ).ptr;
+            return std::wstring( std::cbegin( buffer ), end );
+        }
+        else {
+            static_assert( std::is_convertible_v< const T &, std::wstring_view >, "unsupported WQL literal type" );
+            return wqlString( value );
+        }
+    }
+}
+
+// Escapes the LIKE wildcards in `text`, so it matches literally within a pattern.
+inline std::wstring likeEscape(const std::wstring_view text) {
+    std::wstring escaped;
+    escaped.reserve( text.size() );
+    for ( const wchar_t c: text ) {
+        if ( c == L'%' || c == L'_' || c == L'[' ) {
+            escaped += L'[';
+            escaped += c;
+            escaped += L']';
+        }
+        else { escaped += c; }
+    }
+    return escaped;
+}
+
+// A WQL condition, combined with &&, || and !.
+class Condition {
+public:
+    [[nodiscard]] const std::wstring &wql() const noexcept { return text; }
+
+    friend Condition operator&&(const Condition &lhs, const Condition &rhs) {
+        return Condition( L"(" + lhs.text + L" AND " + rhs.text + L")" );
+    }
+    friend Condition operator||(const Condition &lhs, const Condition &rhs) {
+        return Condition( L"(" + lhs.text + L" OR " + rhs.text + L")" );
+    }
+    friend Condition operator!(const Condition &condition) { return Condition( L"NOT " + condition.text ); }
+
+private:
+    friend class Property;
+    explicit Condition(std::wstring text) : text( std::move( text ) ) {}
+
+    std::wstring text;
+};
+
+// Property operand of a condition, e.g. Property( L"State" ) == L"Running". Values are written as
+// WQL literals; strings are quoted and escaped.
+class Property {
+public:
+    explicit Property(std::wstring name) : name( std::move( name ) ) {}
+
+    template< typename T > Condition operator==(const T &value) const { return compare( L" = ", value ); }
+    template< typename T > Condition operator!=(const T &value) const { return compare( L" <> ", value ); }
+    template< typename T > Condition operator<(const T &value) const { return compare( L" < ", value ); }
+    template< typename T > Condition operator<=(const T &value) const { return compare( L" <= ", value ); }
+    template< typename T > Condition operator>(const T &value) const { return compare( L" > ", value ); }
+    template< typename T > Condition operator>=(const T &value) const { return compare( L" >= ", value ); }
+
+    // `pattern` keeps its wildcards; pass literal parts through likeEscape.
+    [[nodiscard]] Condition like(const std::wstring_view pattern) const { return compare( L" LIKE ", pattern ); }
+    // True if the property, typically an embedded object such as TargetInstance, is of `className`.
+    [[nodiscard]] Condition isa(const std::wstring_view className) const { return compare( L" ISA ", className ); }
+    [[nodiscard]] Condition isNull() const { return Condition( name + L" IS NULL" ); }
+    [[nodiscard]] Condition isNotNull() const { return Condition( name + L" IS NOT NULL" ); }
+
+private:
+    template< typename T >
+    Condition compare(const std::wstring_view op, const T &value) const {
+        std::wstring text = name;
+        text += op;
+        text += utils::wqlLiteral( value );
+        return Condition( std::move( text ) );
+    }
+
+    std::wstring name;
+};
+
+// SELECT query with an optional WHERE clause that is evaluated by the provider.
+class Query {
+public:
+    explicit Query(std::wstring className) : from( std::move( className ) ) {}
+
+    Query &select(const std::initializer_list< std::wstring_view > properties) {
+        return select< std::initializer_list< std::wstring_view > >( properties );
+    }
+
+    // `properties` is any sized range of strings or string views.
+    template< typename Properties >
+    Query &select(const Properties &properties) {
+        columns.assign( std::begin( properties ), std::end( properties ) );
+        return *this;
+    }
+
+    // Conditions given in several calls must all hold. Compound conditions are parenthesized, so
+    // they can be joined without changing precedence.
+    Query &where(const Condition &condition) {
+        if ( !filter.empty() ) { filter += L" AND "; }
+        filter += condition.wql();
+        return *this;
+    }
+
+    [[nodiscard]] const std::wstring &className() const noexcept { return from; }
+
+    // The query without its WHERE clause, which determines the shape of the returned objects.
+    [[nodiscard]] std::wstring projection() const {
+        std::size_t length = std::wstring_view( L"SELECT * FROM " ).size() + from.size();
+        for ( const auto &column: columns ) { length += column.size() + 1; }
+
+        std::wstring query;
+        query.reserve( length );
+        query += L"SELECT ";
+        if ( !columns.empty() ) {
+            for ( const auto &column: columns ) {
+                query += column;
+                query += L',';
+            }
+            query.pop_back();
+        }
+        else { query += L'*'; }
+        query += L" FROM ";
+        query += from;
+        return query;
+    }
+
+    [[nodiscard]] std::wstring wql() const {
+        std::wstring query = projection();
+        if ( !filter.empty() ) {
+            query += L" WHERE ";
+            query += filter;
+        }
+        return query;
+    }
+
+private:
+    std::wstring from;
+    std::vector< std::wstring > columns;
+    std::wstring filter;
+};
+
+// Notification query for ExecNotificationQueryAsync. Intrinsic events are found by WMI comparing
+// the class every `within`; extrinsic events, such as Win32_ProcessStartTrace, are raised by their
+// provider as they happen.
+class EventQuery {
+public:
+    static EventQuery created(const std::wstring_view className, const std::chrono::milliseconds within) {
+        return intrinsic( L"__InstanceCreationEvent", className, within );
+    }
+
+    static EventQuery deleted(const std::wstring_view className, const std::chrono::milliseconds within) {
+        return intrinsic( L"__InstanceDeletionEvent", className, within );
+    }
+
+    static EventQuery modified(const std::wstring_view className, const std::chrono::milliseconds within) {
+        return intrinsic( L"__InstanceModificationEvent", className, within );
+    }
+
+    static EventQuery extrinsic(std::wstring eventClass) { return EventQuery( std::move( eventClass ) ); }
+
+    // Intrinsic events refer to the monitored instance as TargetInstance, e.g.
+    // Property( L"TargetInstance.Name" ) == L"notepad.exe".
+    EventQuery &where(const Condition &condition) {
+        if ( !filter.empty() ) { filter += L" AND "; }
+        filter += condition.wql();
+        return *this;
+    }
+
+    [[nodiscard]] const std::wstring &className() const noexcept { return from; }
+
+    [[nodiscard]] std::wstring wql() const {
+        std::wstring query = L"SELECT * FROM " + from;
+        if ( polling.count() > 0 ) {
+            query += L" WITHIN ";
+            query += utils::wqlLiteral( static_cast< double >( polling.count() ) / 1000.0 );
+        }
+        if ( !filter.empty() ) {
+            query += L" WHERE ";
+            query += filter;
+        }
+        return query;
+    }
+
+private:
+    explicit EventQuery(std::wstring eventClass) : from( std::move( eventClass ) ) {}
+
+    static EventQuery intrinsic(
+        const wchar_t *eventClass, const std::wstring_view className, const std::chrono::milliseconds within) {
+        EventQuery query( eventClass );
+        query.polling = within;
+        query.where( Property( L"TargetInstance" ).isa( className ) );
+        return query;
+    }
+
+    std::wstring from;
+    std::chrono::milliseconds polling{ 0 };
+    std::wstring filter;
+};
+
+// What the WMI callback does with an event while the subscription's queue is full.
+enum class Backpressure {
+    // Wait for room. WMI holds back further events in the meantime.
+    Block,
+    // Discard the new event.
+    DropNewest,
+    // Discard the oldest queued event to make room.
+    DropOldest
+};
+
+struct EventOptions {
+    // Queued events before backpressure applies, rounded up to a power of two.
+    std::size_t capacity = 1024;
+    // Most events taken from the queue at once.
+    std::size_t batchSize = 64;
+    Backpressure backpressure = Backpressure::Block;
+    // Threads that call the handler passed to subscribe().
+    unsigned consumers = 1;
+    // How often idle consumer threads check whether the subscription was cancelled.
+    std::chrono::milliseconds pollInterval{ 100 };
+};
+
+struct ConnectionOptions {
+    std::wstring nameSpace = L"ROOT\\CIMV2";
+    // Take the connection from ConnectionPool instead of connecting for this client alone.
+    bool pooled = true;
+    ComThreading threading = ComThreading::Managed;
+    // Remote computer by name or address; empty connects to the local computer.
+    std::wstring host;
+    // DOMAIN\user or user@domain for a remote host; empty connects as the calling user.
+    std::wstring user;
+    std::wstring password;
+    // Passed to ConnectServer, e.g. L"ntlmdomain:DOMAIN" or L"kerberos:DOMAIN\\HOST".
+    std::wstring authority;
+    // RPC_C_AUTHN_LEVEL_PKT_PRIVACY encrypts the traffic of remote connections.
+    DWORD authenticationLevel = RPC_C_AUTHN_LEVEL_CALL;
+    DWORD impersonationLevel = RPC_C_IMP_LEVEL_IMPERSONATE;
+};
+
+namespace utils {
+    // `\\host\namespace` for a remote host, the namespace alone for the local computer.
+    inline std::wstring serverPath(const ConnectionOptions &connection) {
+        if ( connection.host.empty() ) return connection.nameSpace;
+        return L"\\\\" + connection.host + L'\\' + connection.nameSpace;
+    }
+
+    // The server path and the account a connection connects as.
+    inline std::wstring accountKey(const std::wstring &path, const ConnectionOptions &connection) {
+        return path + L'|' + connection.user + L'|' + connection.authority;
+    }
+
+    // The explicit credentials of a connection. Proxies keep a pointer to `identity` in their blanket
+    // rather than a copy, so whoever holds such a proxy holds the AuthIdentity as well.
+    struct AuthIdentity {
+        AuthIdentity() = default;
+        AuthIdentity(const AuthIdentity &) = delete;
+        AuthIdentity &operator=(const AuthIdentity &) = delete;
+
+        // Runs once no proxy can point at the identity any more.
+        ~AuthIdentity() noexcept { SecureZeroMemory( password.data(), password.size() * sizeof( wchar_t ) ); }
+
+        std::wstring user;
+        std::wstring domain;
+        std::wstring password;
+        COAUTHIDENTITY identity{};
+        // Tells credentials apart without the password, e.g. in cache keys. Never 0.
+        uint64_t generation = 0;
+    };
+
+    using Credentials = std::shared_ptr< const AuthIdentity >;
+
+    // Identities are interned by account and password while anyone holds them, so clients with the
+    // same credentials share one and a client with another password, e.g. one that has not picked
+    // up a rotated password yet, gets its own without disturbing theirs.
+    inline Credentials authIdentity(const std::wstring &account, const std::wstring &password) {
+        if ( account.empty() ) return nullptr;
+
+        static auto *mutex = new std::mutex();
+        static auto *identities = new std::map< std::wstring, std::vector< std::weak_ptr< AuthIdentity > > >();
+        static uint64_t lastGeneration = 0;
+
+        std::lock_guard lock( *mutex );
+        auto &interned = ( *identities )[ account ];
+        std::erase_if( interned, [] (const auto &weak) { return weak.expired(); } );
+        for ( const auto &weak: interned ) {
+            if ( auto entry = weak.lock(); entry && entry->password == password ) return entry;
+        }
+
+        auto entry = std::make_shared< AuthIdentity >();
+        // user@domain is passed as it is; DOMAIN\user is split.
+        if ( const auto slash = account.find( L'\\' ); slash != std::wstring::npos ) {
+            entry->domain = account.substr( 0, slash );
+            entry->user = account.substr( slash + 1 );
+        }
+        else { entry->user = account; }
+        entry->password = password;
+        entry->generation = ++lastGeneration;
+
+        auto &identity = entry->identity;
+        identity.User = reinterpret_cast< USHORT * >( entry->user.data() );
+        identity.UserLength = static_cast< ULONG >( entry->user.size() );
+        identity.Domain = reinterpret_cast< USHORT * >( entry->domain.data() );
+        identity.DomainLength = static_cast< ULONG >( entry->domain.size() );
+        identity.Password = reinterpret_cast< USHORT * >( entry->password.data() );
+        identity.PasswordLength = static_cast< ULONG >( entry->password.size() );
+        identity.Flags = SEC_WINNT_AUTH_IDENTITY_UNICODE;
+        interned.push_back( entry );
+        return entry;
+    }
+
+    // `credentials` must outlive the proxy.
+    inline HRESULT setProxyBlanket(IUnknown *proxy, const ConnectionOptions &connection, const Credentials &credentials) {
+        COAUTHIDENTITY *identity = credentials ? const_cast< COAUTHIDENTITY * >( &credentials->identity ) : nullptr;
+        return CoSetProxyBlanket(
+            proxy,
+            identity ? RPC_C_AUTHN_DEFAULT : RPC_C_AUTHN_WINNT,
+            identity ? RPC_C_AUTHZ_DEFAULT : RPC_C_AUTHZ_NONE,
+            identity ? COLE_DEFAULT_PRINCIPAL : nullptr,
+            connection.authenticationLevel,
+            connection.impersonationLevel,
+            identity,
+            EOAC_NONE
+        );
+    }
+
+    // Identifies what a connection can see: its account and the credentials it proved that with. A
+    // client with a wrong password never shares a key with one that authenticated.
+    inline std::wstring connectionKey(
+        const std::wstring &path, const ConnectionOptions &connection, const Credentials &credentials) {
+        return accountKey( path, connection ) + L'|' + std::to_wstring( credentials ? credentials->generation : 0 );
+    }
+
+    // Remote hosts get WBEM_FLAG_CONNECT_USE_MAX_WAIT, which bounds the call to two minutes.
+    inline HRESULT connectServer(IWbemLocator *locator, const ConnectionOptions &connection, IWbemServices **services) {
+        const auto optional = [] (const std::wstring &str) { return str.empty() ? _bstr_t() : _bstr_t( str.c_str() ); };
+        return locator->ConnectServer(
+            _bstr_t( serverPath( connection ).c_str() ),
+            optional( connection.user ),
+            optional( connection.password ),
+            nullptr,
+            connection.host.empty() ? 0 : WBEM_FLAG_CONNECT_USE_MAX_WAIT,
+            optional( connection.authority ),
+            nullptr,
+            services
+        );
+    }
+}
+
+// Process-wide cache of IWbemServices connections, one per host, namespace and account. Connections
+// are kept in the Global Interface Table, so every thread receives a proxy for its own apartment. A
+// new password for an account replaces its pooled connection; proxies of the old one stay usable for
+// callers that hold its credentials.
+class ConnectionPool {
+public:
+    // Never destroyed: releasing proxies during static destruction would run after COM is torn down.
+    static ConnectionPool &instance() {
+        static auto *pool = new ConnectionPool();
+        return *pool;
+    }
+
+    // Returns a proxy for the calling thread, which must have initialized COM. New connections are
+    // made outside the lock, so a slow or unreachable host holds up only its own callers. A caller
+    // that keeps the proxy keeps utils::authIdentity() of the connection's account as well.
+    utils::ComPtr< IWbemServices > acquire(const ConnectionOptions &connection) {
+        uint64_t generation = 0;
+        return acquire( connection, generation );
+    }
+
+    // Also returns the generation of the pooled connection, which tells invalidate whether the
+    // connection a caller saw fail is still the pooled one.
+    utils::ComPtr< IWbemServices > acquire(const ConnectionOptions &connection, uint64_t &generation) {
+        const std::wstring key = keyOf( connection );
+        const utils::Credentials credentials = utils::authIdentity( connection.user, connection.password );
+        std::unique_lock lock( mutex );
+        auto it = entries.find( key );
+        if ( it == entries.end() || it->second.credentials != credentials ) {
+            lock.unlock();
+            auto connected = connect( connection );
+            lock.lock();
+            // Another thread may have connected with the same credentials in the meantime; its
+            // connection is kept.
+            it = entries.find( key );
+            if ( it == entries.end() ) {
+                it = entries.emplace( key, Entry{ publish( connected ), ++lastGeneration, credentials } ).first;
+            }
+            else if ( it->second.credentials != credentials ) {
+                git->RevokeInterfaceFromGlobal( it->second.cookie );
+                it->second = Entry{ publish( connected ), ++lastGeneration, credentials };
+            }
+        }
+
+        utils::ComPtr< IWbemServices > services;
+        HRESULT hr = table()->GetInterfaceFromGlobal( it->second.cookie, IID_IWbemServices, reinterpret_cast< void ** >( services.put() ) );
+        if ( FAILED( hr ) ) throw utils::Exception( hr );
+        generation = it->second.generation;
+
+        // The blanket belongs to the proxy, so it is set again for every apartment.
+        hr = utils::setProxyBlanket( services.get(), connection, it->second.credentials );
+        if ( FAILED( hr ) ) throw utils::Exception( hr );
+        return services;
+    }
+
+    // Drops the connection of `generation`, whose server went away; the next acquire connects
+    // again. A connection another caller has already replaced is left alone.
+    void invalidate(const ConnectionOptions &connection, const uint64_t generation) {
+        std::lock_guard lock( mutex );
+        if ( const auto it = entries.find( keyOf( connection ) ); it != entries.end() && it->second.generation == generation ) {
+            git->RevokeInterfaceFromGlobal( it->second.cookie );
+            entries.erase( it );
+        }
+    }
+
+    // Releases every pooled connection. Call before the last CoUninitialize of the process.
+    void shutdown() {
+        std::lock_guard lock( mutex );
+        for ( const auto &[ key, entry ]: entries ) { git->RevokeInterfaceFromGlobal( entry.cookie ); }
+        entries.clear();
+        git.reset();
+    }
+
+private:
+    ConnectionPool() = default;
+
+    static std::wstring keyOf(const ConnectionOptions &connection) {
+        return utils::accountKey( utils::serverPath( connection ), connection );
+    }
+
+    static utils::ComPtr< IWbemServices > connect(const ConnectionOptions &connection) {
+        utils::ComPtr< IWbemLocator > locator;
+        HRESULT hr = CoCreateInstance( CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER,
+                                       IID_IWbemLocator, reinterpret_cast< LPVOID * >( locator.put() ) );
+        if ( FAILED( hr ) ) throw utils::Exception( hr );
+
+        utils::ComPtr< IWbemServices > services;
+        hr = utils::connectServer( locator.get(), connection, services.put() );
+        if ( FAILED( hr ) ) throw utils::Exception( hr );
+        return services;
+    }
+
+    DWORD publish(const utils::ComPtr< IWbemServices > &services) {
+        DWORD cookie = 0;
+        const HRESULT hr = table()->RegisterInterfaceInGlobal( services.get(), IID_IWbemServices, &cookie );
+        if ( FAILED( hr ) ) throw utils::Exception( hr );
+        return cookie;
+    }
+
+    IGlobalInterfaceTable *table() {
+        if ( !git ) {
+            const HRESULT hr = CoCreateInstance( CLSID_StdGlobalInterfaceTable, nullptr, CLSCTX_INPROC_SERVER,
+                                                 IID_IGlobalInterfaceTable, reinterpret_cast< LPVOID * >( git.put() ) );
+            if ( FAILED( hr ) ) throw utils::Exception( hr );
+        }
+        return git.get();
+    }
+
+    struct Entry {
+        DWORD cookie = 0;
+        uint64_t generation = 0;
+        // Referenced by the blankets of the connection's proxies.
+        utils::Credentials credentials;
+    };
+
+    std::mutex mutex;
+    utils::ComPtr< IGlobalInterfaceTable > git;
+    std::unordered_map< std::wstring, Entry > entries;
+    uint64_t lastGeneration = 0;
+};
+
+namespace utils {
+    // Scope for the caches of a client that wraps a caller's proxy. Pointer values are reused once
+    // a proxy is freed, so every such client gets a number of its own instead.
+    inline std::wstring wrappedClientPath() {
+        static std::atomic< uint64_t > lastId = 0;
+        return L"*" + std::to_wstring( ++lastId );
+    }
+}
+
+namespace utils {
+    // Query text with whitespace collapsed and everything outside string literals in upper case.
+    // WQL keywords, class and property names are case-insensitive, so equal queries compare equal.
+    inline std::wstring normalizeWql(const std::wstring_view text) {
+        std::wstring normalized;
+        normalized.reserve( text.size() );
+        wchar_t quote = 0;
+        bool space = false;
+        for ( std::size_t i = 0; i < text.size(); ++i ) {
+            const wchar_t c = text[ i ];
+            if ( quote ) {
+                normalized += c;
+                if ( c == L'\\' && i + 1 < text.size() ) { normalized += text[ ++i ]; }
+                else if ( c == quote ) { quote = 0; }
+                continue;
+            }
+            if ( std::iswspace( c ) ) {
+                space = true;
+                continue;
+            }
+            if ( space && !normalized.empty() ) { normalized += L' '; }
+            space = false;
+            if ( c == L'\'' || c == L'"' ) { quote = c; }
+            normalized += static_cast< wchar_t >( std::towupper( c ) );
+        }
+        return normalized;
+    }
+}
+
+// Shares the results of identical queries for a per-class time to live. Concurrent identical
+// queries run once and every caller receives the same immutable result; failures are not cached.
+class ResultCache {
+public:
+    using Result = std::shared_ptr< const std::vector< WindowsManagementInstrumentationObject > >;
+
+    // A zero TTL keeps nothing, but concurrent identical queries are still run once.
+    explicit ResultCache(const std::chrono::milliseconds defaultTtl = std::chrono::seconds( 30 )) : defaultTtl( defaultTtl ) {}
+
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    // Used by clients that were not given a cache of their own.
+    static ResultCache &instance() {
+        static ResultCache cache;
+        return cache;
+    }
+
+    void setTtl(const std::wstring_view className, const std::chrono::milliseconds ttl) {
+        std::lock_guard lock( mutex );
+        ttls.insert_or_assign( utils::normalizeWql( className ), ttl );
+    }
+
+    void setDefaultTtl(const std::chrono::milliseconds ttl) {
+        std::lock_guard lock( mutex );
+        defaultTtl = ttl;
+    }
+
+    // Returns the cached result for `key`, joins a query for it that is already running, or runs
+    // `query` for it. `query` returns the objects and may throw.
+    template< typename F >
+    Result get(const std::wstring &key, const std::wstring_view className, F &&query) {
+        std::promise< Result > promise;
+        std::shared_future< Result > flight;
+        uint64_t id = 0;
+        {
+            std::lock_guard lock( mutex );
+            const auto now = Clock::now();
+            if ( const auto it = entries.find( key ); it != entries.end() && ( it->second.pending || now < it->second.expires ) ) {
+                flight = it->second.result;
+            }
+            else {
+                id = ++lastId;
+                entries.insert_or_assign(
+                    key,
+                    Entry{ promise.get_future().share(), utils::normalizeWql( className ), Clock::time_point::max(), id, true } );
+            }
+        }
+        if ( id == 0 ) return flight.get();
+
+        try {
+            Result result = std::make_shared< const std::vector< WindowsManagementInstrumentationObject > >( query() );
+            promise.set_value( result );
+            finish( key, id, true );
+            return result;
+        }
+        catch ( ... ) {
+            promise.set_exception( std::current_exception() );
+            finish( key, id, false );
+            throw;
+        }
+    }
+
+    // Drops the cached results of one class; queries already running are not affected.
+    void invalidate(const std::wstring_view className) {
+        const std::wstring name = utils::normalizeWql( className );
+        std::lock_guard lock( mutex );
+        std::erase_if( entries, [&] (const auto &entry) { return !entry.second.pending && entry.second.className == name; } );
+    }
+
+    // Drops the results whose TTL has passed, which otherwise stay until their query runs again.
+    void purge() {
+        const auto now = Clock::now();
+        std::lock_guard lock( mutex );
+        std::erase_if( entries, [&] (const auto &entry) { return !entry.second.pending && now >= entry.second.expires; } );
+    }
+
+    void clear() {
+        std::lock_guard lock( mutex );
+        std::erase_if( entries, [] (const auto &entry) { return !entry.second.pending; } );
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::shared_future< Result > result;
+        std::wstring className;
+        Clock::time_point expires;
+        uint64_t id = 0;
+        bool pending = false;
+    };
+
+    void finish(const std::wstring &key, const uint64_t id, const bool succeeded) {
+        std::lock_guard lock( mutex );
+        const auto it = entries.find( key );
+        if ( it == entries.end() || it->second.id != id ) return;
+
+        const auto ttl = ttlOf( it->second.className );
+        if ( !succeeded || ttl.count() <= 0 ) {
+            entries.erase( it );
+            return;
+        }
+        it->second.pending = false;
+        it->second.expires = Clock::now() + ttl;
+    }
+
+    std::chrono::milliseconds ttlOf(const std::wstring &className) const {
+        const auto it = ttls.find( className );
+        return it != ttls.end() ? it->second : defaultTtl;
+    }
+
+    std::mutex mutex;
+    std::chrono::milliseconds defaultTtl;
+    std::unordered_map< std::wstring, std::chrono::milliseconds > ttls;
+    std::unordered_map< std::wstring, Entry > entries;
+    uint64_t lastId = 0;
+};
+
+class WindowsManagementInstrumentationClient {
+public:
+    WindowsManagementInstrumentationClient() : WindowsManagementInstrumentationClient( ConnectionOptions() ) {}
+
+    explicit WindowsManagementInstrumentationClient(const ConnectionOptions &connection)
+        : connection( connection ), credentials( utils::authIdentity( connection.user, connection.password ) ),
+          path( utils::serverPath( connection ) ), threading( connection.threading ) {
+        if ( threading == ComThreading::Managed ) {
+            const HRESULT hr = CoInitializeEx( nullptr, COINIT_MULTITHREADED );
+            THROW_IF_FAILED( hr );
+        }
+
+        try { run( [this] { connect(); } ); }
+        catch ( ... ) {
+            run( [this] { disconnect(); } );
+            if ( threading == ComThreading::Managed ) { CoUninitialize(); }
+            throw;
+        }
+    }
+
+    // Wraps a services proxy the caller connected itself, e.g. with a ConnectServer call of its own.
+    // The caller manages COM on the thread; the client keeps a reference and never reconnects.
+    explicit WindowsManagementInstrumentationClient(IWbemServices *services)
+        : pSvc( services ), connection( ConnectionOptions{ .pooled = false, .threading = ComThreading::CallerManaged } ),
+          path( utils::wrappedClientPath() ), threading( ComThreading::CallerManaged ) {
+        if ( !services ) throw utils::Exception( E_POINTER );
+    }
+
+    ~WindowsManagementInstrumentationClient() noexcept {
+        run( [this] { disconnect(); } );
+        if ( threading == ComThreading::Managed ) { CoUninitialize(); }
+    }
+
+    // Owns a COM initialization of its thread and proxies tied to that apartment: a copy would
+    // uninitialize COM once too often, and a moved-to client could live on another thread.
+    WindowsManagementInstrumentationClient(const WindowsManagementInstrumentationClient &) = delete;
+    WindowsManagementInstrumentationClient &operator=(const WindowsManagementInstrumentationClient &) = delete;
+    WindowsManagementInstrumentationClient(WindowsManagementInstrumentationClient &&) = delete;
+    WindowsManagementInstrumentationClient &operator=(WindowsManagementInstrumentationClient &&) = delete;
+
+    std::vector< WindowsManagementInstrumentationObject > getProperties(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties = {}) const {
+        return getProperties( object, properties, defaultOptions );
+    }
+
+    std::vector< WindowsManagementInstrumentationObject > getProperties(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+        const QueryOptions &options) const;
+
+    // Fills one T per instance of WmiRecord< T >::className, converting each property straight
+    // into its field without going through WmiValue.
+    template< typename T >
+    std::vector< T > getProperties() const { return getProperties< T >( defaultOptions ); }
+
+    template< typename T >
+    std::vector< T > getProperties(const QueryOptions &options) const;
+
+    // Hands every object to the visitor as soon as the enumerator returns it. A visitor returning
+    // false stops the enumeration; the remaining objects are never fetched.
+    template< typename Visitor >
+    void streamProperties(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties, Visitor &&visitor) const {
+        streamProperties( object, properties, std::forward< Visitor >( visitor ), defaultOptions );
+    }
+
+    template< typename Visitor >
+    void streamProperties(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties, Visitor &&visitor,
+        const QueryOptions &options) const;
+
+    // Runs the query through ExecQueryAsync; the visitor is called from a WMI callback thread.
+    template< typename Visitor >
+    AsyncQuery streamPropertiesAsync(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties, Visitor &&visitor) const {
+        return streamPropertiesAsync( object, properties, std::forward< Visitor >( visitor ), defaultOptions );
+    }
+
+    template< typename Visitor >
+    AsyncQuery streamPropertiesAsync(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties, Visitor &&visitor,
+        const QueryOptions &options) const;
+
+    // Like getProperties, but every object is allocated from one arena owned by the result set.
+    ResultSet getResultSet(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties = {}) const;
+
+    ResultSet getResultSet(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+        const QueryOptions &options) const;
+
+    // Runs the query into a columnar table instead of per-object property maps.
+    ResultTable getTable(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties = {}) const;
+
+    ResultTable getTable(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+        const QueryOptions &options) const;
+
+    // Runs the query through ExecQueryAsync. It is stopped through QueryOptions::cancellation and
+    // timeout, after which the future fails with WBEM_E_CALL_CANCELLED or WBEM_E_TIMED_OUT at once.
+    std::future< std::vector< WindowsManagementInstrumentationObject > > getPropertiesAsync(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties = {}) const {
+        return getPropertiesAsync( object, properties, defaultOptions );
+    }
+
+    std::future< std::vector< WindowsManagementInstrumentationObject > > getPropertiesAsync(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+        const QueryOptions &options) const;
+
+    // Overloads for queries built with Query, whose WHERE clause is evaluated by the provider.
+    std::vector< WindowsManagementInstrumentationObject > getProperties(const Query &query) const {
+        return getProperties( query, defaultOptions );
+    }
+
+    std::vector< WindowsManagementInstrumentationObject > getProperties(const Query &query, const QueryOptions &options) const;
+
+    template< typename Visitor >
+    void streamProperties(const Query &query, Visitor &&visitor) const {
+        streamQuery( query, std::forward< Visitor >( visitor ), defaultOptions );
+    }
+
+    template< typename Visitor >
+    void streamProperties(const Query &query, Visitor &&visitor, const QueryOptions &options) const {
+        streamQuery( query, std::forward< Visitor >( visitor ), options );
+    }
+
+    template< typename Visitor >
+    AsyncQuery streamPropertiesAsync(const Query &query, Visitor &&visitor) const {
+        return streamPropertiesAsync( query, std::forward< Visitor >( visitor ), defaultOptions );
+    }
+
+    template< typename Visitor >
+    AsyncQuery streamPropertiesAsync(const Query &query, Visitor &&visitor, const QueryOptions &options) const;
+
+    ResultSet getResultSet(const Query &query) const;
+    ResultSet getResultSet(const Query &query, const QueryOptions &options) const;
+
+    ResultTable getTable(const Query &query) const;
+    ResultTable getTable(const Query &query, const QueryOptions &options) const;
+
+    // Non-throwing variants of getProperties and getTable. Failures are returned as WMI's HRESULT,
+    // or as WBEM_E_TIMED_OUT and WBEM_E_CALL_CANCELLED for the query's timeout and cancellation.
+    Result< std::vector< WindowsManagementInstrumentationObject > > tryGetProperties(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties = {}) const noexcept;
+    Result< std::vector< WindowsManagementInstrumentationObject > > tryGetProperties(const Query &query) const noexcept;
+    Result< std::vector< WindowsManagementInstrumentationObject > > tryGetProperties(
+        const Query &query, const QueryOptions &options) const noexcept;
+
+    Result< ResultTable > tryGetTable(const Query &query) const noexcept;
+    Result< ResultTable > tryGetTable(const Query &query, const QueryOptions &options) const noexcept;
+
+    std::future< std::vector< WindowsManagementInstrumentationObject > > getPropertiesAsync(const Query &query) const {
+        return getPropertiesAsync( query, defaultOptions );
+    }
+
+    std::future< std::vector< WindowsManagementInstrumentationObject > > getPropertiesAsync(
+        const Query &query, const QueryOptions &options) const;
+
+    // Builds the query once for repeated execution; the client must outlive the prepared query.
+    PreparedQuery prepare(const Query &query) const;
+    PreparedQuery prepare(const Query &query, const QueryOptions &options) const;
+
+    // Binds a method for repeated calls, spawning its in-parameters once; the client must outlive it.
+    MethodCall method(const std::wstring &className, const std::wstring &methodName) const;
+    MethodCall method(const std::wstring &className, const std::wstring &methodName, const QueryOptions &options) const;
+
+    // Subscribes through ExecNotificationQueryAsync. Events are taken from the subscription with
+    // next() / nextBatch(); the client must outlive the subscription.
+    EventSubscription subscribe(const EventQuery &query, const EventOptions &options = {}) const;
+
+    // Delivers the events to `handler` in batches, on EventOptions::consumers threads.
+    EventSubscription subscribe(
+        const EventQuery &query, std::function< void(std::span< Event >) > handler,
+        const EventOptions &options = {}) const;
+
+    // Runs the query through a ResultCache, so callers within the class's TTL share one result.
+    // Objects are never arena-backed or lazy, whatever the options say.
+    ResultCache::Result getCached(
+        const std::wstring &object, std::initializer_list< std::wstring_view > properties = {}) const {
+        return getCached( Query( object ).select( properties ), defaultOptions );
+    }
+
+    ResultCache::Result getCached(const Query &query) const { return getCached( query, defaultOptions ); }
+    ResultCache::Result getCached(const Query &query, const QueryOptions &options) const;
+
+    // Cache used by getCached; the process-wide ResultCache::instance() unless set.
+    void setResultCache(ResultCache &cache) noexcept { resultCache = &cache; }
+
+    void setQueryOptions(const QueryOptions &options) { defaultOptions = options; }
+#ifdef SIMPLERWMI_INSTRUMENTATION
+    // Reports the stats of every synchronous query of this client; the observer must outlive it.
+    void setQueryObserver(QueryObserver *queryObserver) noexcept { observer = queryObserver; }
+#endif
+    [[nodiscard]] const QueryOptions &queryOptions() const noexcept { return defaultOptions; }
+
+private:
+    void connect() {
+        if ( connection.pooled ) {
+            pSvc = ConnectionPool::instance().acquire( connection, generation );
+            return;
+        }
+
+        HRESULT hr = CoCreateInstance( CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER,
+                                       IID_IWbemLocator, reinterpret_cast< LPVOID * >( pLoc.put() ) );
+        THROW_IF_FAILED( hr );
+
+        hr = utils::connectServer( pLoc.get(), connection, pSvc.put() );
+        THROW_IF_FAILED( hr );
+
+        hr = utils::setProxyBlanket( pSvc.get(), connection, credentials );
+        THROW_IF_FAILED( hr );
+    }
+
+    void disconnect() noexcept {
+        pSvc.reset();
+        pLoc.reset();
+    }
+
+    // Runs COM work in the apartment this client's proxies belong to.
+    template< typename F >
+    std::invoke_result_t< F & > run(F &&work) const { return utils::runIn( threading, std::forward< F >( work ) ); }
+
+    static long queryFlags(const QueryOptions &options) noexcept {
+        long flags = 0;
+        if ( options.directRead ) { flags |= WBEM_FLAG_DIRECT_READ; }
+        if ( options.amendedQualifiers ) { flags |= WBEM_FLAG_USE_AMENDED_QUALIFIERS; }
+        return flags;
+    }
+
+    // The current proxy. Calls go through a reference of their own, since another thread's
+    // reconnect() may replace the client's at any time.
+    [[nodiscard]] utils::ComPtr< IWbemServices > services() const {
+        std::lock_guard lock( mutex );
+        return pSvc;
+    }
+
+    // Replaces a pooled proxy whose server went away and points `services` at the new one, so the
+    // failed call can be retried once. The new connection is made outside the lock, which only
+    // guards the swap; calls that failed on the same proxy end up sharing one new connection.
+    bool reconnect(const HRESULT hr, utils::ComPtr< IWbemServices > &services) const {
+        if ( !connection.pooled || !utils::isDisconnected( hr ) ) return false;
+
+        uint64_t failed = 0;
+        {
+            std::lock_guard lock( mutex );
+            if ( pSvc.get() != services.get() ) {
+                services = pSvc;
+                return true;
+            }
+            failed = generation;
+        }
+
+        auto &pool = ConnectionPool::instance();
+        pool.invalidate( connection, failed );
+        uint64_t fresh = 0;
+        auto proxy = pool.acquire( connection, fresh );
+
+        std::lock_guard lock( mutex );
+        if ( pSvc.get() == services.get() ) {
+            pSvc = std::move( proxy );
+            generation = fresh;
+        }
+        services = pSvc;
+        return true;
+    }
+
+    // Objects of one class and projection share a schema, whatever the WHERE clause.
+    [[nodiscard]] std::wstring schemaScope(const Query &query) const { return path + L'|' + query.projection() + L'|'; }
+
+    static WindowsManagementInstrumentationObject buildObject(
+        IWbemClassObject *pclsObj, SchemaCache::Scope &schemas, const QueryOptions &options);
+    static void refillObject(
+        IWbemClassObject *pclsObj, SchemaCache::Scope &schemas, const QueryOptions &options,
+        WindowsManagementInstrumentationObject &obj);
+    static bool readPropertyHandle(IWbemObjectAccess *access, const PropertySchema &prop, WmiValue &out);
+    static void resolveHandles(IWbemClassObject *pclsObj, std::vector< PropertySchema > &properties);
+    static bool extractWithHandles(
+        IWbemClassObject *pclsObj, const ClassSchema &schema, const QueryOptions &options,
+        WindowsManagementInstrumentationObject &obj);
+    static bool extractWithSchema(
+        IWbemClassObject *pclsObj, const ClassSchema &schema, const QueryOptions &options,
+        WindowsManagementInstrumentationObject &obj);
+    static WindowsManagementInstrumentationObject extractAndRecord(
+        IWbemClassObject *pclsObj, std::wstring className, SchemaCache::Scope &schemas, const QueryOptions &options);
+
+    template< typename Callback >
+    void enumerate(const std::wstring &query, const QueryOptions &options, Callback &&onObject) const;
+
+    template< typename Callback >
+    void enumerate(
+        const _bstr_t &query, const QueryOptions &options, utils::ComBatch< IWbemClassObject > &batch,
+        Callback &&onObject) const;
+
+    template< typename Callback >
+    HRESULT tryEnumerate(const std::wstring &query, const QueryOptions &options, Callback &&onObject) const;
+
+    template< typename Callback >
+    HRESULT tryEnumerate(
+        const _bstr_t &query, const QueryOptions &options, utils::ComBatch< IWbemClassObject > &batch,
+        Callback &&onObject) const;
+
+    template< typename Visitor >
+    void streamQuery(const Query &query, Visitor &&visitor, const QueryOptions &options) const;
+
+    static void appendRow(IWbemClassObject *pclsObj, SchemaCache::Scope &schemas, ResultTable &table);
+
+    template< typename Visitor >
+    static bool visit(Visitor &visitor, WindowsManagementInstrumentationObject &&obj);
+
+    AsyncQuery execAsync(
+        const Query &query, const QueryOptions &options,
+        std::function< bool(WindowsManagementInstrumentationObject &&) > onObject,
+        std::function< void(HRESULT, std::exception_ptr) > onComplete) const;
+
+    friend class ObjectSink;
+    friend class Refresher;
+    friend class QueryScheduler;
+    friend class PreparedQuery;
+    friend class MethodCall;
+    friend class EventSink;
+
+private:
+    utils::ComPtr< IWbemLocator > pLoc;
+    // Swapped for a fresh proxy by reconnect(), under the mutex.
+    mutable utils::ComPtr< IWbemServices > pSvc;
+    // ConnectionPool generation of pSvc, for pooled clients.
+    mutable uint64_t generation = 0;
+    mutable std::mutex mutex;
+    ConnectionOptions connection;
+    // Referenced by the blankets of the client's proxies, so it outlives them.
+    utils::Credentials credentials;
+    // Server path of the connection, which also scopes cached schemas; a wrapped proxy gets a
+    // scope of its own.
+    std::wstring path;
+    ComThreading threading = ComThreading::Managed;
+    QueryOptions defaultOptions;
+    ResultCache *resultCache = nullptr;
+#ifdef SIMPLERWMI_INSTRUMENTATION
+    QueryObserver *observer = nullptr;
+#endif
+};
+
+class WindowsManagementInstrumentationObject {
+public:
+    WindowsManagementInstrumentationObject() = default;
+
+    // Copies never refer to the source's arena: they use the default resource and own their strings.
+    WindowsManagementInstrumentationObject(const WindowsManagementInstrumentationObject &other) { copyFrom( other ); }
+    // Declared noexcept so vectors of objects relocate by moving, keeping arena-backed values intact.
+    WindowsManagementInstrumentationObject(WindowsManagementInstrumentationObject &&) noexcept = default;
+
+    WindowsManagementInstrumentationObject &operator=(const WindowsManagementInstrumentationObject &other) {
+        if ( this != &other ) {
+            values.clear();
+            copyFrom( other );
+        }
+        return *this;
+    }
+    WindowsManagementInstrumentationObject &operator=(WindowsManagementInstrumentationObject &&) = default;
+
+    // Converts the properties of a lazily extracted object that were not read yet and releases its
+    // IWbemClassObject. Does nothing for objects that were extracted in full.
+    void materialize() const {
+        if ( !source ) return;
+        for ( std::size_t i = 0; i < values.size(); ++i ) {
+            if ( !loaded[ i ] ) { load( i ); }
+        }
+        source.reset();
+        loaded.clear();
+    }
+
+    // False while a lazily extracted object still converts properties from its IWbemClassObject.
+    [[nodiscard]] bool materialized() const noexcept { return !source; }
+
+    // Property layout shared with every other object of the same class from the same query.
+    [[nodiscard]] const ClassSchema *schema() const noexcept { return layout.get(); }
+
+    // Resolves `name` against this object's schema for use in getProperty / getArray on many objects.
+    [[nodiscard]] PropertyKey key(std::wstring name) const {
+        PropertyKey key( std::move( name ) );
+        if ( layout ) {
+            const std::size_t index = layout->indexOf( key.name() );
+            if ( index != ClassSchema::npos ) {
+                key.layout = layout;
+                key.index = index;
+            }
+        }
+        return key;
+    }
+
+    template< typename T >
+    std::optional< T > getProperty(const std::wstring_view prop) const { return valueAs< T >( find( prop ) ); }
+
+    template< typename T >
+    std::optional< T > getProperty(const PropertyKey &key) const { return valueAs< T >( find( key ) ); }
+
+    // The stored value itself, or nullptr if the property is missing or holds another type. Nothing
+    // is copied; the pointer stays valid for the object's lifetime.
+    template< typename T >
+    const T *getPropertyPtr(const std::wstring_view prop) const { return valuePtr< T >( find( prop ) ); }
+
+    template< typename T >
+    const T *getPropertyPtr(const PropertyKey &key) const { return valuePtr< T >( find( key ) ); }
+
+    // Non-allocating access to a string property, whichever storage it was extracted with.
+    std::optional< std::wstring_view > getPropertyView(const std::wstring_view prop) const { return viewOf( find( prop ) ); }
+    std::optional< std::wstring_view > getPropertyView(const PropertyKey &key) const { return viewOf( find( key ) ); }
+
+    template< typename T >
+    std::span< const T > getArray(const std::wstring_view prop) const { return arrayOf< T >( find( prop ) ); }
+
+    template< typename T >
+    std::span< const T > getArray(const PropertyKey &key) const { return arrayOf< T >( find( key ) ); }
+
+private:
+    friend class WindowsManagementInstrumentationClient;
+    friend class Refresher;
+    friend class Snapshot;
+    friend class SerializedResultSet;
+
+    // Values are allocated from `resource` (the default resource if null), one per schema property.
+    WindowsManagementInstrumentationObject(
+        std::shared_ptr< const ClassSchema > schema, std::pmr::memory_resource *resource)
+        : layout( std::move( schema ) ), values( layout->size(), resource ? resource : std::pmr::get_default_resource() ) {}
+
+    WindowsManagementInstrumentationObject(
+        std::shared_ptr< const ClassSchema > schema, std::pmr::vector< WmiValue > &&extracted)
+        : layout( std::move( schema ) ), values( std::move( extracted ) ) {}
+
+    const WmiValue *find(const std::wstring_view prop) const {
+        if ( !layout ) return nullptr;
+        const std::size_t index = layout->indexOf( prop );
+        return index != ClassSchema::npos ? &valueAt( index ) : nullptr;
+    }
+
+    // A key resolved against this object's schema indexes directly; any other key falls back to its name.
+    const WmiValue *find(const PropertyKey &key) const {
+        if ( key.layout && key.layout == layout ) return &valueAt( key.index );
+        return find( key.name() );
+    }
+
+    const WmiValue &valueAt(const std::size_t index) const {
+        if ( source && !loaded[ index ] ) { load( index ); }
+        return values[ index ];
+    }
+
+    void load(const std::size_t index) const {
+        utils::Variant vtProp;
+        CIMTYPE cimType;
+        const HRESULT hr = source->Get( layout->properties()[ index ].name.c_str(), 0, vtProp.put(), &cimType, nullptr );
+        THROW_IF_FAILED( hr );
+        utils::convertVariant( vtProp.get(), cimType, values[ index ], strings, arena );
+        loaded[ index ] = true;
+    }
+
+    // Leaves every value to be converted on first access. Values already held keep their storage
+    // for the conversion, as refillObject does for eager extraction.
+    void bind(IWbemClassObject *pclsObj, const QueryOptions &options) {
+        source = utils::ComPtr< IWbemClassObject >( pclsObj );
+        loaded.assign( values.size(), false );
+        strings = options.strings;
+        arena = options.arena;
+    }
+
+    template< typename T >
+    static std::optional< T > valueAs(const WmiValue *value) {
+        if ( !value ) return std::nullopt;
+
+        if ( auto *val = std::get_if< T >( value ) ) { return *val; }
+        if constexpr ( std::is_same_v< T, std::wstring > ) {
+            if ( auto *str = std::get_if< utils::BStr >( value ) ) { return std::wstring( str->view() ); }
+            if ( auto *str = std::get_if< std::wstring_view >( value ) ) { return std::wstring( *str ); }
+        }
+        return std::nullopt;
+    }
+
+    template< typename T >
+    static const T *valuePtr(const WmiValue *value) { return value ? std::get_if< T >( value ) : nullptr; }
+
+    static std::optional< std::wstring_view > viewOf(const WmiValue *value) {
+        if ( !value ) return std::nullopt;
+
+        if ( auto *str = std::get_if< std::wstring >( value ) ) { return *str; }
+        if ( auto *str = std::get_if< utils::BStr >( value ) ) { return str->view(); }
+        if ( auto *str = std::get_if< std::wstring_view >( value ) ) { return *str; }
+        return std::nullopt;
+    }
+
+    template< typename T >
+    static std::span< const T > arrayOf(const WmiValue *value) {
+        if ( !value ) return {};
+
+        if ( auto *vec = std::get_if< std::vector< T > >( value ) ) { return *vec; }
+        return {};
+    }
+
+    // Binds a default-constructed object to `schema`, as the refresher does for new instances.
+    void rebind(std::shared_ptr< const ClassSchema > schema) {
+        layout = std::move( schema );
+        values.assign( layout->size(), WmiValue() );
+        source.reset();
+        loaded.clear();
+    }
+
+    void copyFrom(const WindowsManagementInstrumentationObject &other) {
+        layout = other.layout;
+        // The copy shares the source object but converts into its own values, never into the arena.
+        source = other.source;
+        loaded = other.loaded;
+        strings = other.strings;
+        arena = nullptr;
+        values.reserve( other.values.size() );
+        for ( const auto &value: other.values ) {
+            if ( const auto *view = std::get_if< std::wstring_view >( &value ) ) { values.emplace_back( std::wstring( *view ) ); }
+            else { values.push_back( value ); }
+        }
+    }
+
+private:
+    std::shared_ptr< const ClassSchema > layout;
+    // Lazily extracted objects fill in values as they are read.
+    mutable std::pmr::vector< WmiValue > values;
+    mutable utils::ComPtr< IWbemClassObject > source;
+    mutable std::vector< bool > loaded;
+    StringStorage strings = StringStorage::Copy;
+    std::pmr::memory_resource *arena = nullptr;
+};
+
+// Query results whose property values and strings live in one arena that is released in a
+// single step when the result set is destroyed.
+class ResultSet final {
+public:
+    ResultSet() = default;
+    ResultSet(ResultSet &&) noexcept = default;
+
+    // The vector's allocator does not propagate on move assignment, so the objects are destroyed
+    // along with their arena and the other set's members are moved in, keeping their own arena.
+    ResultSet &operator=(ResultSet &&other) noexcept {
+        if ( this != &other ) {
+            std::destroy_at( this );
+            std::construct_at( this, std::move( other ) );
+        }
+        return *this;
+    }
+
+    [[nodiscard]] std::span< const WindowsManagementInstrumentationObject > objects() const noexcept { return items; }
+    [[nodiscard]] std::size_t size() const noexcept { return items.size(); }
+    [[nodiscard]] bool empty() const noexcept { return items.empty(); }
+    [[nodiscard]] auto begin() const noexcept { return items.begin(); }
+    [[nodiscard]] auto end() const noexcept { return items.end(); }
+    const WindowsManagementInstrumentationObject &operator[](const std::size_t index) const { return items[ index ]; }
+
+private:
+    friend class WindowsManagementInstrumentationClient;
+    explicit ResultSet(const std::size_t initialSize)
+        : arena( std::make_unique< std::pmr::monotonic_buffer_resource >( initialSize ) ), items( arena.get() ) {}
+
+    // Declared first so the objects are destroyed before the memory they live in.
+    std::unique_ptr< std::pmr::monotonic_buffer_resource > arena;
+    std::pmr::vector< WindowsManagementInstrumentationObject > items;
+};
+
+// Columnar (struct-of-arrays) query result: one contiguous typed column per property, a validity
+// bitmap per column and a string dictionary shared by all string columns.
+class ResultTable {
+public:
+    // Storage element of a column holding T: bools are stored as 0/1 bytes and strings as codes
+    // into dictionary().
+    template< typename T >
+    using Element = std::conditional_t< std::is_same_v< T, bool >, uint8_t,
+        std::conditional_t< std::is_same_v< T, std::wstring >, uint32_t, T > >;
+
+    class Column {
+    public:
+        [[nodiscard]] const std::wstring &name() const noexcept { return columnName; }
+        [[nodiscard]] CIMTYPE type() const noexcept { return cimType; }
+        [[nodiscard]] bool isArray() const noexcept { return ( cimType & CIM_FLAG_ARRAY ) != 0; }
+        [[nodiscard]] bool isNull(const std::size_t row) const noexcept {
+            return ( ( validity[ row / 64 ] >> ( row % 64 ) ) & 1 ) == 0;
+        }
+
+        // Whether the column's elements are of type T (std::wstring for string, datetime and reference columns).
+        template< typename T >
+        [[nodiscard]] bool holds() const noexcept {
+            bool result = false;
+            utils::visitCimType( cimType & ~CIM_FLAG_ARRAY, [&]< CIMTYPE Type > () {
+                result = std::is_same_v< typename utils::CimScalar< Type >::type, T >;
+            } );
+            return result;
+        }
+
+        // One element per row for scalar columns; every element of every row for array columns.
+        template< typename T >
+        [[nodiscard]] std::span< const Element< T > > values() const noexcept {
+            if ( !holds< T >() ) return {};
+            return std::get< std::vector< Element< T > > >( data );
+        }
+
+        // Elements of one row of an array column.
+        template< typename T >
+        [[nodiscard]] std::span< const Element< T > > values(const std::size_t row) const noexcept {
+            const auto all = values< T >();
+            if ( !isArray() || all.empty() ) return {};
+            return all.subspan( offsets[ row ], offsets[ row + 1 ] - offsets[ row ] );
+        }
+
+    private:
+        friend class ResultTable;
+        friend class WindowsManagementInstrumentationClient;
+
+        using Storage = std::variant<
+            std::vector< uint8_t >, std::vector< int8_t >, std::vector< int16_t >, std::vector< uint16_t >,
+            std::vector< int32_t >, std::vector< uint32_t >, std::vector< int64_t >, std::vector< uint64_t >,
+            std::vector< float >, std::vector< double >, std::vector< wchar_t > >;
+        using Appender = void (*)(ResultTable &, Column &, VARIANT &);
+
+        void setValidity(const bool valid) {
+            if ( rows % 64 == 0 ) { validity.push_back( 0 ); }
+            if ( valid ) { validity.back() |= uint64_t{ 1 } << ( rows % 64 ); }
+            ++rows;
+        }
+
+        void appendNull() {
+            std::visit( [this] (auto &vec) { if ( !isArray() ) { vec.emplace_back(); } }, data );
+            if ( isArray() ) { offsets.push_back( offsets.back() ); }
+            setValidity( false );
+        }
+
+        void dropLastRow() {
+            --rows;
+            validity[ rows / 64 ] &= ~( uint64_t{ 1 } << ( rows % 64 ) );
+            if ( rows % 64 == 0 ) { validity.pop_back(); }
+            if ( isArray() ) { offsets.pop_back(); }
+            std::visit( [this] (auto &vec) { vec.resize( isArray() ? offsets.back() : rows ); }, data );
+        }
+
+        std::wstring columnName;
+        CIMTYPE cimType = CIM_EMPTY;
+        Storage data;
+        std::vector< uint64_t > validity;
+        std::vector< uint32_t > offsets;
+        std::size_t rows = 0;
+        Appender append = nullptr;
+        WmiValue scratch;
+    };
+
+    [[nodiscard]] std::size_t rows() const noexcept { return rowCount; }
+    [[nodiscard]] std::span< const Column > columns() const noexcept { return cols; }
+    [[nodiscard]] std::span< const std::wstring > dictionary() const noexcept { return strings; }
+    [[nodiscard]] std::wstring_view string(const uint32_t code) const noexcept { return strings[ code ]; }
+
+    [[nodiscard]] const Column *column(const std::wstring_view name) const noexcept {
+        const auto it = columnIndex.find( name );
+        return it != columnIndex.end() ? &cols[ it->second ] : nullptr;
+    }
+
+    // Shorthand for column( name )->values< T >(); empty if the column is missing or of another type.
+    template< typename T >
+    [[nodiscard]] std::span< const Element< T > > column(const std::wstring_view name) const noexcept {
+        const Column *col = column( name );
+        return col ? col->values< T >() : std::span< const Element< T > >();
+    }
+
+private:
+    friend class WindowsManagementInstrumentationClient;
+
+    uint32_t intern(const std::wstring_view str) {
+        if ( const auto it = stringIndex.find( str ); it != stringIndex.end() ) return it->second;
+        const auto code = static_cast< uint32_t >( strings.size() );
+        strings.emplace_back( str );
+        stringIndex.emplace( strings.back(), code );
+        return code;
+    }
+
+    template< CIMTYPE Type >
+    static void appendScalar(ResultTable &table, Column &column, VARIANT &v) {
+        using T = typename utils::CimScalar< Type >::type;
+        auto &vec = std::get< std::vector< Element< T > > >( column.data );
+        if ( v.vt == VT_NULL || v.vt == VT_EMPTY ) {
+            column.appendNull();
+            return;
+        }
+
+        if constexpr ( std::is_same_v< T, std::wstring > ) { vec.push_back( table.intern( utils::CimScalar< Type >::read( v ) ) ); }
+        else if constexpr ( std::is_same_v< T, bool > ) { vec.push_back( utils::CimScalar< Type >::read( v ) ? 1 : 0 ); }
+        else { vec.push_back( utils::CimScalar< Type >::read( v ) ); }
+        column.setValidity( true );
+    }
+
+    template< CIMTYPE Type >
+    static void appendArray(ResultTable &table, Column &column, VARIANT &v) {
+        using T = typename utils::CimScalar< Type >::type;
+        if ( !( v.vt & VT_ARRAY ) ) {
+            column.appendNull();
+            return;
+        }
+
+        auto &vec = std::get< std::vector< Element< T > > >( column.data );
+        utils::convertArray( v, Type, column.scratch );
+        for ( const auto &element: std::get< std::vector< T > >( column.scratch ) ) {
+            if constexpr ( std::is_same_v< T, std::wstring > ) { vec.push_back( table.intern( element ) ); }
+            else { vec.push_back( static_cast< Element< T > >( element ) ); }
+        }
+        column.offsets.push_back( static_cast< uint32_t >( vec.size() ) );
+        column.setValidity( true );
+    }
+
+    // Returns the column for a property, creating it (null for every earlier row) on first sight, or
+    // nullptr if the type is unsupported or conflicts with an existing column of the same name.
+    Column *resolveColumn(const std::wstring_view name, const CIMTYPE cimType) {
+        if ( const auto it = columnIndex.find( name ); it != columnIndex.end() ) {
+            Column &existing = cols[ it->second ];
+            return existing.cimType == cimType ? &existing : nullptr;
+        }
+
+        Column column;
+        const bool isArray = ( cimType & CIM_FLAG_ARRAY ) != 0;
+        const bool supported = utils::visitCimType( cimType & ~CIM_FLAG_ARRAY, [&]< CIMTYPE Type > () {
+            column.data.emplace< std::vector< Element< typename utils::CimScalar< Type >::type > > >();
+            column.append = isArray ? &appendArray< Type > : &appendScalar< Type >;
+        } );
+        if ( !supported ) return nullptr;
+
+        column.columnName.assign( name );
+        column.cimType = cimType;
+        if ( isArray ) { column.offsets.push_back( 0 ); }
+        for ( std::size_t row = 0; row < rowCount; ++row ) { column.appendNull(); }
+
+        columnIndex.emplace( column.columnName, cols.size() );
+        cols.push_back( std::move( column ) );
+        return &cols.back();
+    }
+
+    // Indices into cols of a cached schema's properties by position, resolved on the schema's first
+    // row; noColumn where resolveColumn has none. Indices stay valid as cols grows.
+    std::span< const std::size_t > layoutOf(const std::shared_ptr< const ClassSchema > &schema) {
+        for ( const auto &layout: layouts ) {
+            if ( layout.schema == schema ) return layout.columns;
+        }
+        std::vector< std::size_t > columns;
+        columns.reserve( schema->properties().size() );
+        for ( const auto &property: schema->properties() ) {
+            const Column *column = resolveColumn( property.name, property.type );
+            columns.push_back( column ? static_cast< std::size_t >( column - cols.data() ) : noColumn );
+        }
+        layouts.push_back( { schema, std::move( columns ) } );
+        return layouts.back().columns;
+    }
+
+    // Closes the current row, marking every column that received no value as null.
+    void finishRow() {
+        ++rowCount;
+        for ( auto &column: cols ) {
+            if ( column.rows < rowCount ) { column.appendNull(); }
+        }
+    }
+
+    struct Layout {
+        std::shared_ptr< const ClassSchema > schema;
+        std::vector< std::size_t > columns;
+    };
+    static constexpr std::size_t noColumn = static_cast< std::size_t >( -1 );
+
+    std::vector< Column > cols;
+    std::unordered_map< std::wstring, std::size_t, utils::StringHash, utils::StringEqual > columnIndex;
+    // Usually a single entry: one per class seen through a cached schema.
+    std::vector< Layout > layouts;
+    std::vector< std::wstring > strings;
+    std::unordered_map< std::wstring_view, uint32_t, utils::StringHash, utils::StringEqual > stringIndex;
+    std::size_t rowCount = 0;
+};
+
+namespace utils {
+    // Embedded objects are left out of extracted objects; events expose theirs through Event.
+    inline bool isEmbeddedObject(const CIMTYPE cimType) noexcept { return ( cimType & ~CIM_FLAG_ARRAY ) == CIM_OBJECT; }
+
+    struct EnumerationScope {
+        explicit EnumerationScope(IWbemClassObject *obj) : obj( obj ) {}
+        EnumerationScope(const EnumerationScope &) = delete;
+        EnumerationScope &operator=(const EnumerationScope &) = delete;
+        ~EnumerationScope() noexcept { obj->EndEnumeration(); }
+
+        IWbemClassObject *obj;
+    };
+}
+
+inline WindowsManagementInstrumentationObject WindowsManagementInstrumentationClient::buildObject(
+    IWbemClassObject *pclsObj, SchemaCache::Scope &schemas, const QueryOptions &options) {
+    SIMPLERWMI_TRACE_PHASE( Extract );
+    std::shared_ptr< const ClassSchema > schema;
+    std::wstring className;
+    {
+        utils::Variant vtClass;
+        const HRESULT hr = pclsObj->Get( L"__CLASS", 0, vtClass.put(), nullptr, nullptr );
+        THROW_IF_FAILED( hr );
+
+        const BSTR bstrClass = vtClass.get().vt == VT_BSTR ? vtClass.get().bstrVal : nullptr;
+        const std::wstring_view name = bstrClass ? std::wstring_view( bstrClass, SysStringLen( bstrClass ) ) : L"";
+        schema = schemas.find( name );
+        if ( !schema ) { className.assign( name ); }
+    }
+
+    if ( schema && options.lazy ) {
+        WindowsManagementInstrumentationObject currentObj( std::move( schema ), options.arena );
+        currentObj.bind( pclsObj, options );
+        return currentObj;
+    }
+    if ( schema ) {
+        WindowsManagementInstrumentationObject currentObj( schema, options.arena );
+        if ( options.useObjectAccess && extractWithHandles( pclsObj, *schema, options, currentObj ) ) return currentObj;
+        if ( extractWithSchema( pclsObj, *schema, options, currentObj ) ) return currentObj;
+        className = schema->className();
+    }
+    return extractAndRecord( pclsObj, std::move( className ), schemas, options );
+}
+
+// Extracts into an object from an earlier run of the same query, reusing its value storage while
+// the object's class stays the same.
+inline void WindowsManagementInstrumentationClient::refillObject(
+    IWbemClassObject *pclsObj, SchemaCache::Scope &schemas, const QueryOptions &options,
+    WindowsManagementInstrumentationObject &obj) {
+    SIMPLERWMI_TRACE_PHASE( Extract );
+    if ( obj.layout ) {
+        utils::Variant vtClass;
+        const HRESULT hr = pclsObj->Get( L"__CLASS", 0, vtClass.put(), nullptr, nullptr );
+        THROW_IF_FAILED( hr );
+
+        const BSTR bstrClass = vtClass.get().vt == VT_BSTR ? vtClass.get().bstrVal : nullptr;
+        if ( bstrClass && obj.layout->className() == std::wstring_view( bstrClass, SysStringLen( bstrClass ) ) ) {
+            if ( options.lazy ) {
+                obj.bind( pclsObj, options );
+                return;
+            }
+            if ( options.useObjectAccess && extractWithHandles( pclsObj, *obj.layout, options, obj ) ) return;
+            if ( extractWithSchema( pclsObj, *obj.layout, options, obj ) ) return;
+        }
+    }
+    obj = buildObject( pclsObj, schemas, options );
+}
+
+// Reads a scalar straight into typed storage, reusing the string buffer already held by `out`.
+// WBEM_S_FALSE marks a NULL property, which is stored as std::monostate like convertVariant does.
+inline bool WindowsManagementInstrumentationClient::readPropertyHandle(
+    IWbemObjectAccess *access, const PropertySchema &prop, WmiValue &out) {
+    if ( prop.handle == -1 ) return false;
+
+    // 8- and 16-bit properties have no dedicated accessor and are read as raw bytes.
+    const auto readSmall = [&]< typename Raw, typename T > () {
+        BYTE buffer[ sizeof( uint64_t ) ] = {};
+        long read = 0;
+        const HRESULT hr = access->ReadPropertyValue( prop.handle, sizeof( buffer ), &read, buffer );
+        if ( FAILED( hr ) ) return false;
+        if ( hr == WBEM_S_FALSE ) {
+            out = std::monostate();
+            return true;
+        }
+        Raw raw;
+        memcpy( &raw, buffer, sizeof( Raw ) );
+        out = static_cast< T >( raw );
+        return true;
+    };
+
+    switch ( prop.type ) {
+    case CIM_SINT32:
+    case CIM_UINT32:
+    case CIM_REAL32: {
+        DWORD value = 0;
+        const HRESULT hr = access->ReadDWORD( prop.handle, &value );
+        if ( FAILED( hr ) ) return false;
+        if ( hr == WBEM_S_FALSE ) { out = std::monostate(); }
+        else if ( prop.type == CIM_SINT32 ) { out = static_cast< int32_t >( value ); }
+        else if ( prop.type == CIM_UINT32 ) { out = static_cast< uint32_t >( value ); }
+        else { out = std::bit_cast< float >( static_cast< uint32_t >( value ) ); }
+        return true;
+    }
+    case CIM_SINT64:
+    case CIM_UINT64:
+    case CIM_REAL64: {
+        uint64_t value = 0;
+        const HRESULT hr = access->ReadQWORD( prop.handle, &value );
+        if ( FAILED( hr ) ) return false;
+        if ( hr == WBEM_S_FALSE ) { out = std::monostate(); }
+        else if ( prop.type == CIM_SINT64 ) { out = static_cast< int64_t >( value ); }
+        else if ( prop.type == CIM_UINT64 ) { out = value; }
+        else { out = std::bit_cast< double >( value ); }
+        return true;
+    }
+    case CIM_BOOLEAN: return readSmall.operator()< int16_t, bool >();
+    case CIM_SINT8: return readSmall.operator()< int8_t, int8_t >();
+    case CIM_UINT8: return readSmall.operator()< uint8_t, uint8_t >();
+    case CIM_SINT16: return readSmall.operator()< int16_t, int16_t >();
+    case CIM_UINT16: return readSmall.operator()< uint16_t, uint16_t >();
+    case CIM_CHAR16: return readSmall.operator()< wchar_t, wchar_t >();
+    case CIM_STRING:
+    case CIM_DATETIME:
+    case CIM_REFERENCE: {
+        thread_local std::vector< BYTE > buffer( 256 );
+        long read = 0;
+        HRESULT hr = access->ReadPropertyValue(
+            prop.handle, static_cast< long >( buffer.size() ), &read, buffer.data() );
+        if ( hr == WBEM_E_BUFFER_TOO_SMALL ) {
+            buffer.resize( static_cast< std::size_t >( read ) );
+            hr = access->ReadPropertyValue(
+                prop.handle, static_cast< long >( buffer.size() ), &read, buffer.data() );
+        }
+        if ( FAILED( hr ) ) return false;
+        if ( hr == WBEM_S_FALSE ) {
+            out = std::monostate();
+            return true;
+        }
+
+        // The byte count includes the terminating null character.
+        const auto *chars = reinterpret_cast< const wchar_t * >( buffer.data() );
+        std::size_t length = static_cast< std::size_t >( read ) / sizeof( wchar_t );
+        if ( length > 0 && chars[ length - 1 ] == L'\0' ) { --length; }
+
+        if ( auto *str = std::get_if< std::wstring >( &out ) ) { str->assign( chars, length ); }
+        else { out.emplace< std::wstring >( chars, length ); }
+        return true;
+    }
+    default: return false;
+    }
+}
+
+inline bool WindowsManagementInstrumentationClient::extractWithHandles(
+    IWbemClassObject *pclsObj, const ClassSchema &schema, const QueryOptions &options,
+    WindowsManagementInstrumentationObject &obj) {
+    utils::ComPtr< IWbemObjectAccess > access;
+    if ( FAILED( pclsObj->QueryInterface( IID_IWbemObjectAccess, reinterpret_cast< void ** >( access.put() ) ) ) ) {
+        return false;
+    }
+
+    const auto properties = schema.properties();
+    for ( std::size_t i = 0; i < properties.size(); ++i ) {
+        const auto &prop = properties[ i ];
+        WmiValue &value = obj.values[ i ];
+        // Handles read strings into a copy, so BSTR storage takes the one Get hands out instead.
+        const bool keepBstr = options.strings == StringStorage::Bstr && utils::isStringType( prop.type );
+        if ( !keepBstr && readPropertyHandle( access.get(), prop, value ) ) {
+            if ( const auto *str = std::get_if< std::wstring >( &value ); str && options.arena ) {
+                value = utils::arenaString( options.arena, *str );
+            }
+        }
+        else {
+            utils::Variant vtProp;
+            CIMTYPE cimType;
+            const HRESULT hr = pclsObj->Get( prop.name.c_str(), 0, vtProp.put(), &cimType, nullptr );
+            THROW_IF_FAILED( hr );
+            SIMPLERWMI_TRACE_PHASE( Convert );
+            utils::convertVariant( vtProp.get(), cimType, value, options.strings, options.arena );
+        }
+        SIMPLERWMI_TRACE( converted( value ) );
+    }
+    return true;
+}
+
+// Walks the object positionally and stores each value at its schema index, so no per-property
+// name lookups or BSTR names are needed. Returns false if the object does not match the schema.
+inline bool WindowsManagementInstrumentationClient::extractWithSchema(
+    IWbemClassObject *pclsObj, const ClassSchema &schema, const QueryOptions &options,
+    WindowsManagementInstrumentationObject &obj) {
+    HRESULT hr = pclsObj->BeginEnumeration( 0 );
+    THROW_IF_FAILED( hr );
+    utils::EnumerationScope enumeration( pclsObj );
+
+    const auto properties = schema.properties();
+    std::size_t index = 0;
+    while ( true ) {
+        utils::Variant vtProp;
+        CIMTYPE cimType;
+        hr = pclsObj->Next( 0, nullptr, vtProp.put(), &cimType, nullptr );
+        if ( hr == WBEM_S_NO_MORE_DATA ) break;
+        THROW_IF_FAILED( hr );
+
+        if ( utils::isEmbeddedObject( cimType ) ) continue;
+        if ( index >= properties.size() || properties[ index ].type != cimType ) return false;
+        {
+            SIMPLERWMI_TRACE_PHASE( Convert );
+            utils::convertVariant( vtProp.get(), cimType, obj.values[ index ], options.strings, options.arena );
+        }
+        SIMPLERWMI_TRACE( converted( obj.values[ index ] ) );
+        ++index;
+    }
+    return index == properties.size();
+}
+
+// Handles are fixed per class definition, so they are resolved once alongside the schema.
+inline void WindowsManagementInstrumentationClient::resolveHandles(
+    IWbemClassObject *pclsObj, std::vector< PropertySchema > &properties) {
+    utils::ComPtr< IWbemObjectAccess > access;
+    if ( FAILED( pclsObj->QueryInterface( IID_IWbemObjectAccess, reinterpret_cast< void ** >( access.put() ) ) ) ) return;
+
+    for ( auto &prop: properties ) {
+        if ( ( prop.type & CIM_FLAG_ARRAY ) || prop.type == CIM_OBJECT ) continue;
+        if ( ( prop.flavor & WBEM_FLAVOR_MASK_ORIGIN ) == WBEM_FLAVOR_ORIGIN_SYSTEM ) continue;
+
+        long handle = -1;
+        CIMTYPE handleType;
+        if ( SUCCEEDED( access->GetPropertyHandle( prop.name.c_str(), &handleType, &handle ) ) ) { prop.handle = handle; }
+    }
+}
+
+inline WindowsManagementInstrumentationObject WindowsManagementInstrumentationClient::extractAndRecord(
+    IWbemClassObject *pclsObj, std::wstring className, SchemaCache::Scope &schemas, const QueryOptions &options) {
+    HRESULT hr = pclsObj->BeginEnumeration( 0 );
+    THROW_IF_FAILED( hr );
+    utils::EnumerationScope enumeration( pclsObj );
+
+    std::pmr::vector< WmiValue > values( options.arena ? options.arena : std::pmr::get_default_resource() );
+    std::vector< PropertySchema > properties;
+    while ( true ) {
+        BSTR bstrName = nullptr;
+        utils::Variant vtProp;
+        CIMTYPE cimType;
+        LONG flFlavor = 0;
+        hr = pclsObj->Next( 0, &bstrName, vtProp.put(), &cimType, &flFlavor );
+        if ( hr == WBEM_S_NO_MORE_DATA ) break;
+        THROW_IF_FAILED( hr );
+
+        std::wstring name( bstrName, SysStringLen( bstrName ) );
+        SysFreeString( bstrName );
+        if ( utils::isEmbeddedObject( cimType ) ) continue;
+
+        // Lazy objects only need the schema; their values are converted when they are read.
+        if ( options.lazy ) { values.emplace_back(); }
+        else {
+            {
+                SIMPLERWMI_TRACE_PHASE( Convert );
+                utils::convertVariant( vtProp.get(), cimType, values.emplace_back(), options.strings, options.arena );
+            }
+            SIMPLERWMI_TRACE( converted( values.back() ) );
+        }
+        properties.push_back( { std::move( name ), cimType, flFlavor } );
+    }
+
+    resolveHandles( pclsObj, properties );
+    auto schema = std::make_shared< const ClassSchema >( std::move( className ), std::move( properties ) );
+    schemas.store( schema );
+    WindowsManagementInstrumentationObject obj( std::move( schema ), std::move( values ) );
+    if ( options.lazy ) { obj.bind( pclsObj, options ); }
+    return obj;
+}
+
+template< typename Callback >
+void WindowsManagementInstrumentationClient::enumerate(
+    const std::wstring &query, const QueryOptions &options, Callback &&onObject) const {
+    THROW_IF_FAILED( tryEnumerate( query, options, std::forward< Callback >( onObject ) ) );
+}
+
+template< typename Callback >
+void WindowsManagementInstrumentationClient::enumerate(
+    const _bstr_t &query, const QueryOptions &options, utils::ComBatch< IWbemClassObject > &batch,
+    Callback &&onObject) const {
+    THROW_IF_FAILED( tryEnumerate( query, options, batch, std::forward< Callback >( onObject ) ) );
+}
+
+template< typename Callback >
+HRESULT WindowsManagementInstrumentationClient::tryEnumerate(
+    const std::wstring &query, const QueryOptions &options, Callback &&onObject) const {
+    utils::ComBatch< IWbemClassObject > batch( options.batchSize );
+    return tryEnumerate( _bstr_t( query.c_str() ), options, batch, std::forward< Callback >( onObject ) );
+}
+
+// Failures of WMI itself, timeouts and cancellation are returned; only the callback throws.
+template< typename Callback >
+HRESULT WindowsManagementInstrumentationClient::tryEnumerate(
+    const _bstr_t &query, const QueryOptions &options, utils::ComBatch< IWbemClassObject > &batch,
+    Callback &&onObject) const {
+    // The callback extracts properties, so it runs in the enumerator's apartment as well.
+    return run( [&] {
+#ifdef SIMPLERWMI_INSTRUMENTATION
+        utils::QueryTrace trace( static_cast< const wchar_t * >( query ), options.stats, observer );
+#endif
+        const auto body = [&] () -> HRESULT {
+            utils::ComPtr< IEnumWbemClassObject > pEnumerator;
+            auto pServices = services();
+            const auto exec = [&] {
+                SIMPLERWMI_TRACE_PHASE( Exec );
+                return pServices->ExecQuery(
+                    utils::wqlLanguage(),
+                    query,
+                    WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY | queryFlags( options ),
+                    nullptr,
+                    pEnumerator.put()
+                );
+            };
+            HRESULT hr = exec();
+            if ( reconnect( hr, pServices ) ) { hr = exec(); }
+            if ( FAILED( hr ) ) return hr;
+
+            // The enumerator is a proxy of its own, which needs the explicit credentials as well.
+            if ( credentials ) {
+                hr = utils::setProxyBlanket( pEnumerator.get(), connection, credentials );
+                if ( FAILED( hr ) ) return hr;
+            }
+
+            // With a timeout or cancellation token, Next blocks for at most one poll interval at a time
+            // and returns WBEM_S_TIMEDOUT together with whatever arrived in the meantime.
+            using Clock = std::chrono::steady_clock;
+            const bool limited = options.timeout.count() > 0;
+            const bool polled = limited || options.cancellation.stop_possible();
+            const auto deadline = limited ? Clock::now() + options.timeout : Clock::time_point::max();
+            long timeout = WBEM_INFINITE;
+            const auto nextTimeout = [&] () -> HRESULT {
+                if ( !polled ) return S_OK;
+                if ( options.cancellation.stop_requested() ) return WBEM_E_CALL_CANCELLED;
+
+                const auto now = Clock::now();
+                if ( now >= deadline ) return WBEM_E_TIMED_OUT;
+                const auto remaining = std::chrono::ceil< std::chrono::milliseconds >( deadline - now );
+                timeout = static_cast< long >( std::min( remaining, options.pollInterval ).count() );
+                return S_OK;
+            };
+
+            // The last batch may be partial: Next returns WBEM_S_FALSE together with the remaining objects.
+            do {
+                batch.release();
+                if ( hr = nextTimeout(); FAILED( hr ) ) return hr;
+                {
+                    SIMPLERWMI_TRACE_PHASE( Next );
+                    hr = pEnumerator->Next( timeout, batch.capacity(), batch.data(), batch.count() );
+                }
+                if ( FAILED( hr ) ) return hr;
+                SIMPLERWMI_TRACE( returned( batch.objects().size() ) );
+
+                for ( IWbemClassObject *pclsObj: batch.objects() ) {
+                    if ( !onObject( pclsObj ) ) return S_OK;
+                }
+            } while ( hr != WBEM_S_FALSE );
+            return S_OK;
+        };
+
+        const HRESULT hr = body();
+        SIMPLERWMI_TRACE( status( hr ) );
+        return hr;
+    } );
+}
+
+template< typename Visitor >
+void WindowsManagementInstrumentationClient::streamProperties(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties, Visitor &&visitor,
+    const QueryOptions &options) const {
+    streamQuery( Query( object ).select( properties ), std::forward< Visitor >( visitor ), options );
+}
+
+template< typename Visitor >
+void WindowsManagementInstrumentationClient::streamQuery(
+    const Query &query, Visitor &&visitor, const QueryOptions &options) const {
+    SchemaCache::Scope schemas( schemaScope( query ) );
+    enumerate( query.wql(), options, [&] (IWbemClassObject *pclsObj) {
+        return visit( visitor, buildObject( pclsObj, schemas, options ) );
+    } );
+}
+
+template< typename Visitor >
+bool WindowsManagementInstrumentationClient::visit(Visitor &visitor, WindowsManagementInstrumentationObject &&obj) {
+    if constexpr ( std::is_same_v< std::invoke_result_t< Visitor &, WindowsManagementInstrumentationObject && >, bool > ) {
+        return static_cast< bool >( visitor( std::move( obj ) ) );
+    }
+    else {
+        visitor( std::move( obj ) );
+        return true;
+    }
+}
+
+template< typename T >
+std::vector< T > WindowsManagementInstrumentationClient::getProperties(const QueryOptions &options) const {
+    const std::wstring query( recordQuery< T >.data() );
+    std::vector< T > records;
+    records.reserve( options.batchSize );
+    enumerate( query, options, [&] (IWbemClassObject *pclsObj) {
+        SIMPLERWMI_TRACE_PHASE( Extract );
+        T &record = records.emplace_back();
+        std::apply( [&] (const auto &...fields) {
+            const auto read = [&] (const auto &field) {
+                utils::Variant vtProp;
+                CIMTYPE cimType;
+                const HRESULT hr = pclsObj->Get( field.name.data(), 0, vtProp.put(), &cimType, nullptr );
+                THROW_IF_FAILED( hr );
+                SIMPLERWMI_TRACE_PHASE( Convert );
+                utils::readField( vtProp.get(), cimType, record.*field.member );
+                SIMPLERWMI_TRACE( converted() );
+            };
+            ( read( fields ), ... );
+        }, WmiRecord< T >::fields );
+        return true;
+    } );
+    return records;
+}
+
+inline std::vector< WindowsManagementInstrumentationObject > WindowsManagementInstrumentationClient::getProperties(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+    const QueryOptions &options) const {
+    return getProperties( Query( object ).select( properties ), options );
+}
+
+inline std::vector< WindowsManagementInstrumentationObject > WindowsManagementInstrumentationClient::getProperties(
+    const Query &query, const QueryOptions &options) const {
+    // The result count is unknown up front, but at least one batch is usually returned.
+    std::vector< WindowsManagementInstrumentationObject > results;
+    results.reserve( options.batchSize );
+    streamQuery( query, [&] (WindowsManagementInstrumentationObject &&obj) {
+        results.push_back( std::move( obj ) );
+    }, options );
+    return results;
+}
+
+inline Result< std::vector< WindowsManagementInstrumentationObject > >
+WindowsManagementInstrumentationClient::tryGetProperties(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties) const noexcept {
+    return utils::capture( [&] { return tryGetProperties( Query( object ).select( properties ), defaultOptions ); } );
+}
+
+inline Result< std::vector< WindowsManagementInstrumentationObject > >
+WindowsManagementInstrumentationClient::tryGetProperties(const Query &query) const noexcept {
+    return tryGetProperties( query, defaultOptions );
+}
+
+inline Result< std::vector< WindowsManagementInstrumentationObject > >
+WindowsManagementInstrumentationClient::tryGetProperties(const Query &query, const QueryOptions &options) const noexcept {
+    using Objects = std::vector< WindowsManagementInstrumentationObject >;
+    return utils::capture( [&] () -> Result< Objects > {
+        Objects results;
+        results.reserve( options.batchSize );
+        SchemaCache::Scope schemas( schemaScope( query ) );
+        const HRESULT hr = tryEnumerate( query.wql(), options, [&] (IWbemClassObject *pclsObj) {
+            results.push_back( buildObject( pclsObj, schemas, options ) );
+            return true;
+        } );
+        if ( FAILED( hr ) ) return Result< Objects >::failure( hr );
+        return results;
+    } );
+}
+
+// The key includes the account and credentials, which decide what WMI returns as much as the
+// flags do; timeouts and cancellation only apply to the caller that ends up running the query.
+inline ResultCache::Result WindowsManagementInstrumentationClient::getCached(
+    const Query &query, const QueryOptions &options) const {
+    std::wstring key = utils::connectionKey( utils::normalizeWql( path ), connection, credentials );
+    key += L'|';
+    key += std::to_wstring( queryFlags( options ) );
+    key += L'|';
+    key += utils::normalizeWql( query.wql() );
+
+    ResultCache &cache = resultCache ? *resultCache : ResultCache::instance();
+    return cache.get( key, query.className(), [&] {
+        QueryOptions owned = options;
+        owned.arena = nullptr;
+        owned.lazy = false;
+        return getProperties( query, owned );
+    } );
+}
+
+inline ResultSet WindowsManagementInstrumentationClient::getResultSet(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties) const {
+    return getResultSet( object, properties, defaultOptions );
+}
+
+inline ResultSet WindowsManagementInstrumentationClient::getResultSet(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+    const QueryOptions &options) const {
+    return getResultSet( Query( object ).select( properties ), options );
+}
+
+inline ResultSet WindowsManagementInstrumentationClient::getResultSet(const Query &query) const {
+    return getResultSet( query, defaultOptions );
+}
+
+inline ResultSet WindowsManagementInstrumentationClient::getResultSet(
+    const Query &query, const QueryOptions &options) const {
+    ResultSet results( 64 * 1024 );
+    QueryOptions arenaOptions = options;
+    arenaOptions.arena = results.arena.get();
+    results.items.reserve( options.batchSize );
+
+    streamQuery( query, [&] (WindowsManagementInstrumentationObject &&obj) {
+        results.items.push_back( std::move( obj ) );
+    }, arenaOptions );
+    return results;
+}
+
+inline ResultTable WindowsManagementInstrumentationClient::getTable(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties) const {
+    return getTable( object, properties, defaultOptions );
+}
+
+inline ResultTable WindowsManagementInstrumentationClient::getTable(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+    const QueryOptions &options) const {
+    return getTable( Query( object ).select( properties ), options );
+}
+
+inline ResultTable WindowsManagementInstrumentationClient::getTable(const Query &query) const {
+    return getTable( query, defaultOptions );
+}
+
+inline ResultTable WindowsManagementInstrumentationClient::getTable(const Query &query, const QueryOptions &options) const {
+    SchemaCache::Scope schemas( schemaScope( query ) );
+
+    ResultTable table;
+    enumerate( query.wql(), options, [&] (IWbemClassObject *pclsObj) {
+        appendRow( pclsObj, schemas, table );
+        return true;
+    } );
+    return table;
+}
+
+inline Result< ResultTable > WindowsManagementInstrumentationClient::tryGetTable(const Query &query) const noexcept {
+    return tryGetTable( query, defaultOptions );
+}
+
+inline Result< ResultTable > WindowsManagementInstrumentationClient::tryGetTable(
+    const Query &query, const QueryOptions &options) const noexcept {
+    return utils::capture( [&] () -> Result< ResultTable > {
+        SchemaCache::Scope schemas( schemaScope( query ) );
+        ResultTable table;
+        const HRESULT hr = tryEnumerate( query.wql(), options, [&] (IWbemClassObject *pclsObj) {
+            appendRow( pclsObj, schemas, table );
+            return true;
+        } );
+        if ( FAILED( hr ) ) return Result< ResultTable >::failure( hr );
+        return table;
+    } );
+}
+
+// Values are appended straight into the columns. Objects of a cached class are walked
+// positionally and their columns resolved once per schema; others are walked by name and record
+// their schema for the following rows.
+inline void WindowsManagementInstrumentationClient::appendRow(
+    IWbemClassObject *pclsObj, SchemaCache::Scope &schemas, ResultTable &table) {
+    SIMPLERWMI_TRACE_PHASE( Extract );
+    std::shared_ptr< const ClassSchema > schema;
+    std::wstring className;
+    {
+        utils::Variant vtClass;
+        const HRESULT hr = pclsObj->Get( L"__CLASS", 0, vtClass.put(), nullptr, nullptr );
+        THROW_IF_FAILED( hr );
+        className.assign( utils::CimScalar< CIM_STRING >::read( vtClass.get() ) );
+        schema = schemas.find( className );
+    }
+
+    HRESULT hr = pclsObj->BeginEnumeration( 0 );
+    THROW_IF_FAILED( hr );
+    utils::EnumerationScope enumeration( pclsObj );
+
+    if ( schema ) {
+        const auto properties = schema->properties();
+        const auto columns = table.layoutOf( schema );
+        std::size_t index = 0;
+        bool matches = true;
+        while ( true ) {
+            utils::Variant vtProp;
+            CIMTYPE cimType;
+            hr = pclsObj->Next( 0, nullptr, vtProp.put(), &cimType, nullptr );
+            if ( hr == WBEM_S_NO_MORE_DATA ) break;
+            THROW_IF_FAILED( hr );
+
+            if ( utils::isEmbeddedObject( cimType ) ) continue;
+            if ( index >= properties.size() || properties[ index ].type != cimType ) {
+                matches = false;
+                break;
+            }
+            if ( columns[ index ] != ResultTable::noColumn ) {
+                SIMPLERWMI_TRACE_PHASE( Convert );
+                auto &column = table.cols[ columns[ index ] ];
+                column.append( table, column, vtProp.get() );
+                SIMPLERWMI_TRACE( converted() );
+            }
+            ++index;
+        }
+        if ( matches && index == properties.size() ) {
+            table.finishRow();
+            return;
+        }
+
+        // The object does not match the cached layout: drop the partial row and walk it by name.
+        for ( auto &column: table.cols ) {
+            if ( column.rows > table.rowCount ) { column.dropLastRow(); }
+        }
+        hr = pclsObj->BeginEnumeration( 0 );
+        THROW_IF_FAILED( hr );
+    }
+
+    std::vector< PropertySchema > recorded;
+    while ( true ) {
+        BSTR bstrName = nullptr;
+        utils::Variant vtProp;
+        CIMTYPE cimType;
+        LONG flFlavor = 0;
+        hr = pclsObj->Next( 0, &bstrName, vtProp.put(), &cimType, &flFlavor );
+        if ( hr == WBEM_S_NO_MORE_DATA ) break;
+        THROW_IF_FAILED( hr );
+
+        std::wstring name( bstrName, SysStringLen( bstrName ) );
+        SysFreeString( bstrName );
+        // Left out of the schema as in extractAndRecord, which shares it.
+        if ( utils::isEmbeddedObject( cimType ) ) continue;
+
+        if ( auto *column = table.resolveColumn( name, cimType ); column && column->rows == table.rowCount ) {
+            SIMPLERWMI_TRACE_PHASE( Convert );
+            column->append( table, *column, vtProp.get() );
+            SIMPLERWMI_TRACE( converted() );
+        }
+        recorded.push_back( { std::move( name ), cimType, flFlavor } );
+    }
+    table.finishRow();
+
+    resolveHandles( pclsObj, recorded );
+    schemas.store( std::make_shared< const ClassSchema >( std::move( className ), std::move( recorded ) ) );
+}
+
+class ObjectSink final : public IWbemObjectSink {
+public:
+    using ObjectHandler = std::function< bool(WindowsManagementInstrumentationObject &&) >;
+    using CompletionHandler = std::function< void(HRESULT, std::exception_ptr) >;
+
+    ObjectSink(
+        const ComThreading threading, std::wstring schemaScope, QueryOptions options,
+        ObjectHandler onObject, CompletionHandler onComplete)
+        : threading( threading ), schemas( std::move( schemaScope ) ), options( std::move( options ) ),
+          onObject( std::move( onObject ) ), onComplete( std::move( onComplete ) ) {
+        // Objects are built on WMI's callback thread and handed to another one.
+        this->options.lazy = false;
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++refCount; }
+
+    ULONG STDMETHODCALLTYPE Release() override {
+        const ULONG remaining = --refCount;
+        if ( remaining == 0 ) { delete this; }
+        return remaining;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppv) override {
+        if ( IsEqualIID( riid, IID_IUnknown ) || IsEqualIID( riid, IID_IWbemObjectSink ) ) {
+            *ppv = static_cast< IWbemObjectSink * >( this );
+            AddRef();
+            return WBEM_S_NO_ERROR;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    // The visitor runs without `mutex` held, so it may cancel its own query; the completion it
+    // causes is then reported once the visitor has returned. A visitor that returns false or
+    // throws cancels the call as a cancellation token would, so WMI stops enumerating.
+    HRESULT STDMETHODCALLTYPE Indicate(long lObjectCount, IWbemClassObject **apObjArray) override {
+        std::lock_guard serial( delivery );
+        {
+            std::lock_guard lock( mutex );
+            if ( stopped ) return WBEM_S_NO_ERROR;
+            delivering = true;
+        }
+        bool early = false;
+        for ( long i = 0; i < lObjectCount && !stopped; ++i ) {
+            try {
+                if ( !onObject( WindowsManagementInstrumentationClient::buildObject( apObjArray[ i ], schemas, options ) ) ) { early = true; }
+            }
+            catch ( ... ) {
+                failure = std::current_exception();
+                early = true;
+            }
+            if ( early ) { cancel( failure ? WBEM_E_CALL_CANCELLED : WBEM_S_NO_ERROR ); }
+        }
+        std::optional< HRESULT > deferred;
+        {
+            std::lock_guard lock( mutex );
+            delivering = false;
+            deferred = std::exchange( completion, std::nullopt );
+        }
+        if ( deferred ) { onComplete( *deferred, failure ); }
+        return WBEM_S_NO_ERROR;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetStatus(long lFlags, HRESULT hResult, BSTR, IWbemClassObject *) override {
+        if ( lFlags == WBEM_STATUS_COMPLETE ) { complete( hResult ); }
+        return WBEM_S_NO_ERROR;
+    }
+
+    // Enforces the query's timeout and cancellation token once the call has started on `proxy`,
+    // which is the one cancellations go to, even if the client reconnects later.
+    void watch(utils::ComPtr< IWbemServices > proxy) {
+        bool cancelled = false;
+        {
+            // The caller's thread may be an STA one, whose proxy the watchdog could not call.
+            if ( threading == ComThreading::CallerManaged && ( options.timeout.count() > 0 || options.cancellation.stop_possible() ) ) {
+                shared.emplace( proxy.get() );
+            }
+            std::lock_guard lock( mutex );
+            services = std::move( proxy );
+            cancelled = std::exchange( cancelPending, false );
+            if ( options.timeout.count() > 0 && !completed ) {
+                utils::ComPtr< ObjectSink > self( this );
+                ticket = utils::Watchdog::instance().watch(
+                    utils::Watchdog::Clock::now() + options.timeout, [self] { self->cancel( WBEM_E_TIMED_OUT ); } );
+                watched = true;
+            }
+        }
+        if ( cancelled ) { cancelCall(); }
+        // Constructed outside the lock: the callback runs immediately if a stop was already requested.
+        if ( options.cancellation.stop_possible() ) {
+            onStop = std::make_unique< std::stop_callback< std::function< void() > > >(
+                options.cancellation, [this] { cancel( WBEM_E_CALL_CANCELLED ); } );
+        }
+    }
+
+private:
+    // Completes the query with `hr` right away, whether or not WMI honors the cancellation. Stop
+    // callbacks run on whichever thread requested the stop, so the call itself is cancelled from
+    // the watchdog's MTA thread unless the worker owns the proxy.
+    void cancel(const HRESULT hr) {
+        complete( hr );
+        {
+            // WMI may deliver objects before ExecQueryAsync has returned; watch() cancels those calls.
+            std::lock_guard lock( mutex );
+            if ( !services ) {
+                cancelPending = true;
+                return;
+            }
+        }
+        cancelCall();
+    }
+
+    void cancelCall() {
+        utils::ComPtr< ObjectSink > self( this );
+        if ( threading == ComThreading::Worker ) {
+            // Not waited for: the worker may be busy, and this may be the watchdog's only thread.
+            utils::ComWorker::instance().post( [self] { self->services->CancelAsyncCall( self.get() ); } );
+            return;
+        }
+        utils::Watchdog::instance().watch( utils::Watchdog::Clock::now(), [self] {
+            if ( !self->shared ) {
+                self->services->CancelAsyncCall( self.get() );
+            } else if ( const auto proxy = self->shared->get() ) {
+                proxy->CancelAsyncCall( self.get() );
+            }
+        } );
+    }
+
+    // Reports the completion at once unless a visitor is running, which then reports it itself.
+    void complete(const HRESULT hr) {
+        bool unwatch = false;
+        bool report = false;
+        {
+            std::lock_guard lock( mutex );
+            stopped = true;
+            if ( completed ) return;
+            completed = true;
+            unwatch = std::exchange( watched, false );
+            if ( delivering ) { completion = hr; }
+            else { report = true; }
+        }
+        if ( unwatch ) { utils::Watchdog::instance().unwatch( ticket ); }
+        if ( report ) { onComplete( hr, failure ); }
+    }
+
+    std::atomic< ULONG > refCount = 0;
+    utils::ComPtr< IWbemServices > services;
+    std::optional< utils::GlobalServices > shared;
+    ComThreading threading;
+    std::mutex mutex;
+    std::mutex delivery;
+    SchemaCache::Scope schemas;
+    QueryOptions options;
+    ObjectHandler onObject;
+    CompletionHandler onComplete;
+    std::exception_ptr failure;
+    std::atomic< bool > stopped = false;
+    bool completed = false;
+    bool delivering = false;
+    std::optional< HRESULT > completion;
+    utils::Watchdog::Ticket ticket;
+    bool watched = false;
+    bool cancelPending = false;
+    std::unique_ptr< std::stop_callback< std::function< void() > > > onStop;
+};
+
+inline void AsyncQuery::cancel() const {
+    if ( pSvc && sink ) { utils::runIn( threading, [this] { pSvc->CancelAsyncCall( sink.get() ); } ); }
+}
+
+inline AsyncQuery WindowsManagementInstrumentationClient::execAsync(
+    const Query &query, const QueryOptions &options,
+    std::function< bool(WindowsManagementInstrumentationObject &&) > onObject,
+    std::function< void(HRESULT, std::exception_ptr) > onComplete) const {
+    auto done = std::make_shared< std::promise< void > >();
+    std::shared_future< void > completion = done->get_future().share();
+
+    utils::ComPtr< ObjectSink > sink( new ObjectSink(
+        threading,
+        schemaScope( query ),
+        options,
+        std::move( onObject ),
+        [done, onComplete = std::move( onComplete )] (HRESULT hr, std::exception_ptr failure) {
+            onComplete( hr, failure );
+            if ( failure ) { done->set_exception( failure ); }
+            else if ( FAILED( hr ) ) { done->set_exception( std::make_exception_ptr( utils::Exception( hr ) ) ); }
+            else { done->set_value(); }
+        } ) );
+
+    const _bstr_t wql( query.wql().c_str() );
+    auto pServices = services();
+    const auto exec = [&] {
+        return pServices->ExecQueryAsync(
+            utils::wqlLanguage(),
+            wql,
+            WBEM_FLAG_BIDIRECTIONAL | queryFlags( options ),
+            nullptr,
+            sink.get()
+        );
+    };
+    run( [&] {
+        HRESULT hr = exec();
+        if ( reconnect( hr, pServices ) ) { hr = exec(); }
+        THROW_IF_FAILED( hr );
+    } );
+    sink->watch( pServices );
+
+    return { pServices.get(), std::move( sink ), std::move( completion ), threading };
+}
+
+template< typename Visitor >
+AsyncQuery WindowsManagementInstrumentationClient::streamPropertiesAsync(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties, Visitor &&visitor,
+    const QueryOptions &options) const {
+    return streamPropertiesAsync( Query( object ).select( properties ), std::forward< Visitor >( visitor ), options );
+}
+
+template< typename Visitor >
+AsyncQuery WindowsManagementInstrumentationClient::streamPropertiesAsync(
+    const Query &query, Visitor &&visitor, const QueryOptions &options) const {
+    return execAsync(
+        query,
+        options,
+        [visitor = std::forward< Visitor >( visitor )] (WindowsManagementInstrumentationObject &&obj) mutable {
+            return visit( visitor, std::move( obj ) );
+        },
+        [] (HRESULT, std::exception_ptr) {} );
+}
+
+inline std::future< std::vector< WindowsManagementInstrumentationObject > >
+WindowsManagementInstrumentationClient::getPropertiesAsync(
+    const std::wstring &object, std::initializer_list< std::wstring_view > properties,
+    const QueryOptions &options) const {
+    return getPropertiesAsync( Query( object ).select( properties ), options );
+}
+
+inline std::future< std::vector< WindowsManagementInstrumentationObject > >
+WindowsManagementInstrumentationClient::getPropertiesAsync(const Query &query, const QueryOptions &options) const {
+    struct State {
+        std::vector< WindowsManagementInstrumentationObject > results;
+        std::promise< std::vector< WindowsManagementInstrumentationObject > > promise;
+    };
+    auto state = std::make_shared< State >();
+    auto future = state->promise.get_future();
+
+    execAsync(
+        query,
+        options,
+        [state] (WindowsManagementInstrumentationObject &&obj) {
+            state->results.push_back( std::move( obj ) );
+            return true;
+        },
+        [state] (HRESULT hr, std::exception_ptr failure) {
+            if ( failure ) { state->promise.set_exception( failure ); }
+            else if ( FAILED( hr ) ) { state->promise.set_exception( std::make_exception_ptr( utils::Exception( hr ) ) ); }
+            else { state->promise.set_value( std::move( state->results ) ); }
+        } );
+    return future;
+}
+
+// Query that is run many times. The WQL string, enumerator batch and schema are kept between
+// executions, and objects of an unchanged class are refilled in place, much like Refresher does
+// for performance classes. Each run fills the objects of the run before the last one, so a failed
+// run never touches the objects it would have replaced.
+class PreparedQuery {
+public:
+    [[nodiscard]] const std::wstring &wql() const noexcept { return text; }
+
+    // Runs the query. The objects stay valid until the next execution; a failed run leaves the
+    // previous objects as they were.
+    std::span< const WindowsManagementInstrumentationObject > execute() {
+        THROW_IF_FAILED( fill() );
+        return objects();
+    }
+
+    // Runs the query without throwing; a failed run leaves the previous objects in place.
+    Result< std::span< const WindowsManagementInstrumentationObject > > tryExecute() noexcept {
+        return utils::capture( [&] () -> Result< std::span< const WindowsManagementInstrumentationObject > > {
+            const HRESULT hr = fill();
+            if ( FAILED( hr ) ) return Result< std::span< const WindowsManagementInstrumentationObject > >::failure( hr );
+            return objects();
+        } );
+    }
+
+    [[nodiscard]] std::span< const WindowsManagementInstrumentationObject > objects() const noexcept {
+        return { instances.data(), active };
+    }
+
+private:
+    friend class WindowsManagementInstrumentationClient;
+
+    HRESULT fill() {
+        std::size_t count = 0;
+        const HRESULT hr = client->tryEnumerate( query, options, batch, [&] (IWbemClassObject *pclsObj) {
+            if ( count < spare.size() ) {
+                WindowsManagementInstrumentationClient::refillObject( pclsObj, schemas, options, spare[ count ] );
+            }
+            else { spare.push_back( WindowsManagementInstrumentationClient::buildObject( pclsObj, schemas, options ) ); }
+            ++count;
+            return true;
+        } );
+        batch.release();
+
+        // Objects past the current count keep their storage for later executions.
+        if ( SUCCEEDED( hr ) ) {
+            std::swap( instances, spare );
+            active = count;
+        }
+        return hr;
+    }
+
+    PreparedQuery(const WindowsManagementInstrumentationClient &client, const Query &source, const QueryOptions &queryOptions)
+        : client( &client ), text( source.wql() ), query( text.c_str() ), schemas( client.schemaScope( source ) ),
+          options( queryOptions ), batch( queryOptions.batchSize ) {
+        // Refilled objects would keep allocating from an arena that is never released.
+        options.arena = nullptr;
+    }
+
+    const WindowsManagementInstrumentationClient *client;
+    std::wstring text;
+    _bstr_t query;
+    SchemaCache::Scope schemas;
+    QueryOptions options;
+    utils::ComBatch< IWbemClassObject > batch;
+    std::vector< WindowsManagementInstrumentationObject > instances;
+    // Filled by the next run, and swapped with `instances` once it succeeds.
+    std::vector< WindowsManagementInstrumentationObject > spare;
+    std::size_t active = 0;
+};
+
+inline PreparedQuery WindowsManagementInstrumentationClient::prepare(const Query &query) const {
+    return prepare( query, defaultOptions );
+}
+
+inline PreparedQuery WindowsManagementInstrumentationClient::prepare(const Query &query, const QueryOptions &options) const {
+    return { *this, query, options };
+}
+
+// Method of a WMI class, bound once for repeated calls. The in-parameter class is spawned a single
+// time and its values are kept between calls, so only the parameters that change have to be set
+// again. Output parameters come back as an object, through the same extraction path as queries.
+class MethodCall {
+public:
+    [[nodiscard]] const std::wstring &className() const noexcept { return target; }
+
+    // Sets an in-parameter for this and later calls. Arrays are passed as std::vector.
+    template< typename T >
+    MethodCall &set(const std::wstring_view name, const T &value) {
+        const auto it = parameters.find( name );
+        if ( it == parameters.end() ) throw utils::Exception( WBEM_E_NOT_FOUND );
+
+        utils::Variant vtValue;
+        utils::writeVariant( vtValue.get(), it->second, value );
+        const std::wstring parameter( name );
+        client->run( [&] {
+            const HRESULT hr = inParams->Put( parameter.c_str(), 0, &vtValue.get(), 0 );
+            THROW_IF_FAILED( hr );
+        } );
+        return *this;
+    }
+
+    // Sets an in-parameter back to NULL.
+    MethodCall &reset(const std::wstring_view name) {
+        if ( !parameters.contains( name ) ) throw utils::Exception( WBEM_E_NOT_FOUND );
+
+        utils::Variant vtNull;
+        vtNull.get().vt = VT_NULL;
+        const std::wstring parameter( name );
+        client->run( [&] {
+            const HRESULT hr = inParams->Put( parameter.c_str(), 0, &vtNull.get(), 0 );
+            THROW_IF_FAILED( hr );
+        } );
+        return *this;
+    }
+
+    // Calls the method on the instance at `objectPath`, e.g. Win32_Process.Handle="4", and returns
+    // its output parameters, ReturnValue included.
+    WindowsManagementInstrumentationObject invoke(const std::wstring &objectPath) {
+        const _bstr_t path( objectPath.c_str() );
+        return client->run( [&] {
+            utils::ComPtr< IWbemClassObject > outParams;
+            auto pServices = client->services();
+            const auto exec = [&] {
+                return pServices->ExecMethod( path, method, 0, nullptr, inParams.get(), outParams.put(), nullptr );
+            };
+            HRESULT hr = exec();
+            if ( client->reconnect( hr, pServices ) ) { hr = exec(); }
+            THROW_IF_FAILED( hr );
+
+            if ( !outParams ) return WindowsManagementInstrumentationObject();
+            return WindowsManagementInstrumentationClient::buildObject( outParams.get(), schemas, options );
+        } );
+    }
+
+    // Calls a static method, such as Win32_Process.Create.
+    WindowsManagementInstrumentationObject invoke() { return invoke( target ); }
+
+    // Starts the call without waiting for it, so many calls can be in flight at once. The
+    // in-parameters are marshalled when the call is made and may be changed right after.
+    std::future< WindowsManagementInstrumentationObject > invokeAsync(const std::wstring &objectPath) const {
+        struct State {
+            WindowsManagementInstrumentationObject result;
+            std::promise< WindowsManagementInstrumentationObject > promise;
+        };
+        auto state = std::make_shared< State >();
+        auto future = state->promise.get_future();
+
+        utils::ComPtr< ObjectSink > sink( new ObjectSink(
+            client->threading,
+            scope,
+            options,
+            [state] (WindowsManagementInstrumentationObject &&obj) {
+                state->result = std::move( obj );
+                return true;
+            },
+            [state] (HRESULT hr, std::exception_ptr failure) {
+                if ( failure ) { state->promise.set_exception( failure ); }
+                else if ( FAILED( hr ) ) { state->promise.set_exception( std::make_exception_ptr( utils::Exception( hr ) ) ); }
+                else { state->promise.set_value( std::move( state->result ) ); }
+            } ) );
+
+        const _bstr_t path( objectPath.c_str() );
+        auto pServices = client->services();
+        const auto exec = [&] {
+            return pServices->ExecMethodAsync( path, method, 0, nullptr, inParams.get(), sink.get() );
+        };
+        client->run( [&] {
+            HRESULT hr = exec();
+            if ( client->reconnect( hr, pServices ) ) { hr = exec(); }
+            THROW_IF_FAILED( hr );
+        } );
+        sink->watch( std::move( pServices ) );
+        return future;
+    }
+
+    std::future< WindowsManagementInstrumentationObject > invokeAsync() const { return invokeAsync( target ); }
+
+private:
+    friend class WindowsManagementInstrumentationClient;
+
+    using ParameterTypes = std::unordered_map< std::wstring, CIMTYPE, utils::StringHash, utils::StringEqual >;
+
+    MethodCall(
+        const WindowsManagementInstrumentationClient &client, std::wstring className, const std::wstring &methodName,
+        utils::ComPtr< IWbemClassObject > inParams, ParameterTypes parameters, const QueryOptions &queryOptions)
+        : client( &client ), target( std::move( className ) ), method( methodName.c_str() ),
+          inParams( std::move( inParams ) ), parameters( std::move( parameters ) ),
+          // Every method's output parameters are a __PARAMETERS object of their own shape.
+          scope( client.path + L'|' + target + L'.' + methodName + L'|' ), schemas( scope ), options( queryOptions ) {
+        // Results outlive any single call, so they never come from the caller's arena.
+        options.arena = nullptr;
+    }
+
+    const WindowsManagementInstrumentationClient *client;
+    std::wstring target;
+    _bstr_t method;
+    // Null for methods without in-parameters.
+    utils::ComPtr< IWbemClassObject > inParams;
+    ParameterTypes parameters;
+    std::wstring scope;
+    SchemaCache::Scope schemas;
+    QueryOptions options;
+};
+
+inline MethodCall WindowsManagementInstrumentationClient::method(
+    const std::wstring &className, const std::wstring &methodName) const {
+    return method( className, methodName, defaultOptions );
+}
+
+inline MethodCall WindowsManagementInstrumentationClient::method(
+    const std::wstring &className, const std::wstring &methodName, const QueryOptions &options) const {
+    return run( [&] {
+        const _bstr_t bstrClass( className.c_str() );
+        utils::ComPtr< IWbemClassObject > classObj;
+        auto pServices = services();
+        const auto get = [&] { return pServices->GetObject( bstrClass, 0, nullptr, classObj.put(), nullptr ); };
+        HRESULT hr = get();
+        if ( reconnect( hr, pServices ) ) { hr = get(); }
+        THROW_IF_FAILED( hr );
+
+        utils::ComPtr< IWbemClassObject > inSignature;
+        hr = classObj->GetMethod( methodName.c_str(), 0, inSignature.put(), nullptr );
+        THROW_IF_FAILED( hr );
+
+        utils::ComPtr< IWbemClassObject > inParams;
+        MethodCall::ParameterTypes parameters;
+        if ( inSignature ) {
+            hr = inSignature->SpawnInstance( 0, inParams.put() );
+            THROW_IF_FAILED( hr );
+
+            hr = inSignature->BeginEnumeration( WBEM_FLAG_NONSYSTEM_ONLY );
+            THROW_IF_FAILED( hr );
+            utils::EnumerationScope enumeration( inSignature.get() );
+            while ( true ) {
+                BSTR bstrName = nullptr;
+                CIMTYPE cimType;
+                hr = inSignature->Next( 0, &bstrName, nullptr, &cimType, nullptr );
+                if ( hr == WBEM_S_NO_MORE_DATA ) break;
+                THROW_IF_FAILED( hr );
+
+                parameters.emplace( std::wstring( bstrName, SysStringLen( bstrName ) ), cimType );
+                SysFreeString( bstrName );
+            }
+        }
+        return MethodCall( *this, className, methodName, std::move( inParams ), std::move( parameters ), options );
+    } );
+}
+
+namespace utils {
+    // Bounded multi-producer, multi-consumer ring buffer. Every cell carries a sequence number that
+    // tells producers and consumers whose turn it is, so neither side takes a lock.
+    template< typename T >
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(const std::size_t capacity)
+            : cells( std::bit_ceil( std::max< std::size_t >( capacity, 2 ) ) ), mask( cells.size() - 1 ) {
+            for ( std::size_t i = 0; i < cells.size(); ++i ) { cells[ i ].sequence.store( i, std::memory_order_relaxed ); }
+        }
+
+        // Leaves `item` untouched if the queue is full.
+        bool tryPush(T &&item) {
+            std::size_t pos = tail.load( std::memory_order_relaxed );
+            while ( true ) {
+                Cell &cell = cells[ pos & mask ];
+                const auto diff = static_cast< std::ptrdiff_t >( cell.sequence.load( std::memory_order_acquire ) - pos );
+                if ( diff == 0 ) {
+                    if ( tail.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                        cell.value.emplace( std::move( item ) );
+                        cell.sequence.store( pos + 1, std::memory_order_release );
+                        return true;
+                    }
+                }
+                else if ( diff < 0 ) return false;
+                else { pos = tail.load( std::memory_order_relaxed ); }
+            }
+        }
+
+        [[nodiscard]] std::size_t capacity() const noexcept { return cells.size(); }
+
+        std::optional< T > tryPop() {
+            std::size_t pos = head.load( std::memory_order_relaxed );
+            while ( true ) {
+                Cell &cell = cells[ pos & mask ];
+                const auto diff = static_cast< std::ptrdiff_t >( cell.sequence.load( std::memory_order_acquire ) - ( pos + 1 ) );
+                if ( diff == 0 ) {
+                    if ( head.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                        std::optional< T > item( std::move( cell.value ) );
+                        cell.value.reset();
+                        cell.sequence.store( pos + cells.size(), std::memory_order_release );
+                        return item;
+                    }
+                }
+                else if ( diff < 0 ) return std::nullopt;
+                else { pos = head.load( std::memory_order_relaxed ); }
+            }
+        }
+
+    private:
+        struct alignas( 64 ) Cell {
+            std::atomic< std::size_t > sequence;
+            std::optional< T > value;
+        };
+
+        std::vector< Cell > cells;
+        std::size_t mask;
+        alignas( 64 ) std::atomic< std::size_t > tail = 0;
+        alignas( 64 ) std::atomic< std::size_t > head = 0;
+    };
+
+    // BoundedQueue with blocking consumers and a backpressure policy for producers. `available`
+    // counts queued items and `space` free cells, so a consumer that acquired `available` is owed
+    // exactly one item and a producer that acquired `space` exactly one cell. Both sides sleep on
+    // their semaphore while they have to wait.
+    template< typename T >
+    class Channel {
+    public:
+        Channel(const std::size_t capacity, const Backpressure policy)
+            : queue( capacity ), space( static_cast< std::ptrdiff_t >( queue.capacity() ) ), policy( policy ) {}
+
+        // Returns false if the item, or an older one in its place, was dropped, or if the channel
+        // is closed.
+        bool push(T &&item) {
+            bool dropped = false;
+            if ( policy == Backpressure::Block ) {
+                if ( !waitForSpace() ) return reject();
+            }
+            else {
+                if ( isClosed() ) return reject();
+                while ( !space.try_acquire() ) {
+                    if ( policy == Backpressure::DropNewest ) return reject();
+                    if ( available.try_acquire() ) {
+                        take();
+                        drops.fetch_add( 1, std::memory_order_relaxed );
+                        dropped = true;
+                    }
+                    // Consumers hold every queued item; their cells are about to be freed.
+                    else { std::this_thread::yield(); }
+                }
+            }
+            // The cell is ours, but the consumer that freed it may still be clearing it.
+            while ( !queue.tryPush( std::move( item ) ) ) { std::this_thread::yield(); }
+            available.release();
+            return !dropped;
+        }
+
+        std::optional< T > pop(const std::chrono::milliseconds timeout) {
+            if ( !available.try_acquire_for( timeout ) ) return std::nullopt;
+            return take();
+        }
+
+        // Waits up to `timeout` for the first item, then appends whatever else is queued, up to `max`.
+        std::size_t pop(std::vector< T > &out, const std::size_t max, const std::chrono::milliseconds timeout) {
+            if ( max == 0 || !available.try_acquire_for( timeout ) ) return 0;
+            std::size_t count = 0;
+            do {
+                out.push_back( take() );
+                ++count;
+            } while ( count < max && available.try_acquire() );
+            return count;
+        }
+
+        // Releases blocked producers and rejects further items; queued items can still be taken.
+        void close() noexcept {
+            closed.store( true );
+            // Every producer that went to sleep before seeing `closed` is woken with a cell of its own.
+            space.release( blocked.load() );
+        }
+
+        [[nodiscard]] bool isClosed() const noexcept { return closed.load( std::memory_order_acquire ); }
+        [[nodiscard]] uint64_t dropped() const noexcept { return drops.load( std::memory_order_relaxed ); }
+
+    private:
+        // False once the channel is closed. `blocked` is raised before `closed` is checked, so
+        // close() either sees this producer or this producer sees `closed`.
+        bool waitForSpace() {
+            if ( isClosed() ) return false;
+            if ( space.try_acquire() ) return true;
+            blocked.fetch_add( 1 );
+            if ( !closed.load() ) { space.acquire(); }
+            blocked.fetch_sub( 1 );
+            return !isClosed();
+        }
+
+        bool reject() noexcept {
+            drops.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+
+        // The item is committed, but a producer may still be writing an earlier cell.
+        T take() {
+            while ( true ) {
+                if ( auto item = queue.tryPop() ) {
+                    space.release();
+                    return std::move( *item );
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        BoundedQueue< T > queue;
+        std::counting_semaphore<> available{ 0 };
+        std::counting_semaphore<> space;
+        Backpressure policy;
+        std::atomic< bool > closed = false;
+        std::atomic< std::ptrdiff_t > blocked = 0;
+        std::atomic< uint64_t > drops = 0;
+    };
+}
+
+// One notification. `object` holds the event's own properties, such as TIME_CREATED or the
+// ProcessName of Win32_ProcessStartTrace.
+struct Event {
+    WindowsManagementInstrumentationObject object;
+    // The created or deleted instance, or the new state of a modified one.
+    std::optional< WindowsManagementInstrumentationObject > targetInstance;
+    // The state of a modified instance before the change.
+    std::optional< WindowsManagementInstrumentationObject > previousInstance;
+};
+
+// Running event subscription. Events are converted on the WMI callback thread and queued until a
+// consumer takes them; destroying the subscription cancels it.
+class EventSubscription {
+public:
+    EventSubscription(EventSubscription &&) noexcept = default;
+    ~EventSubscription() noexcept { cancel(); }
+
+    std::optional< Event > next(const std::chrono::milliseconds timeout) { return state->channel.pop( timeout ); }
+
+    // Appends up to EventOptions::batchSize events, waiting up to `timeout` for the first one.
+    std::size_t nextBatch(std::vector< Event > &events, const std::chrono::milliseconds timeout) {
+        return state->channel.pop( events, state->options.batchSize, timeout );
+    }
+
+    // Returns without waiting for WMI. The call is cancelled on the proxy's own apartment: on the
+    // worker, or on the watchdog's MTA thread, through the global interface table for proxies of
+    // the caller's apartment, which may be an STA one.
+    void cancel() noexcept {
+        if ( !sink ) return;
+        state->channel.close();
+        // Only allocation can fail here; WMI then ends the call once the subscription is released.
+        try { cancelCall(); }
+        catch ( ... ) {}
+        sink.reset();
+        pSvc.reset();
+        shared.reset();
+
+        for ( auto &consumer: consumers ) {
+            consumer.request_stop();
+            // A handler cancelling its own subscription cannot wait for itself.
+            if ( consumer.get_id() == std::this_thread::get_id() ) { consumer.detach(); }
+            else { consumer.join(); }
+        }
+        consumers.clear();
+    }
+
+    // WBEM_S_NO_ERROR until WMI ends the subscription, then the status it ended with.
+    [[nodiscard]] HRESULT status() const noexcept { return state->status.load(); }
+
+    // The first exception thrown while converting an event or by the handler.
+    [[nodiscard]] std::exception_ptr failure() const {
+        std::lock_guard lock( state->mutex );
+        return state->failure;
+    }
+
+    // Events discarded by the backpressure policy.
+    [[nodiscard]] uint64_t dropped() const noexcept { return state->channel.dropped(); }
+
+private:
+    friend class WindowsManagementInstrumentationClient;
+    friend class EventSink;
+
+    struct State {
+        explicit State(const EventOptions &options) : options( options ), channel( options.capacity, options.backpressure ) {}
+
+        void fail(std::exception_ptr error) {
+            std::lock_guard lock( mutex );
+            if ( !failure ) { failure = std::move( error ); }
+        }
+
+        EventOptions options;
+        utils::Channel< Event > channel;
+        std::atomic< HRESULT > status = WBEM_S_NO_ERROR;
+        mutable std::mutex mutex;
+        std::exception_ptr failure;
+    };
+
+    EventSubscription(
+        utils::ComPtr< IWbemServices > pSvc, utils::ComPtr< IWbemObjectSink > sink, std::shared_ptr< State > state,
+        const ComThreading threading)
+        : pSvc( std::move( pSvc ) ), sink( std::move( sink ) ), state( std::move( state ) ), threading( threading ) {
+        if ( threading == ComThreading::CallerManaged ) { shared = std::make_shared< utils::GlobalServices >( this->pSvc.get() ); }
+    }
+
+    // The worker's proxy is handed to the worker and released there; a proxy of the caller's
+    // apartment stays with the caller, which releases it.
+    void cancelCall() {
+        if ( threading == ComThreading::Worker ) {
+            utils::ComWorker::instance().post( [pSvc = std::move( pSvc ), sink = sink] { pSvc->CancelAsyncCall( sink.get() ); } );
+        }
+        else if ( shared ) {
+            utils::Watchdog::instance().watch( utils::Watchdog::Clock::now(), [shared = shared, sink = sink] {
+                if ( const auto proxy = shared->get() ) { proxy->CancelAsyncCall( sink.get() ); }
+            } );
+        }
+        else {
+            utils::Watchdog::instance().watch( utils::Watchdog::Clock::now(), [pSvc = pSvc, sink = sink] {
+                pSvc->CancelAsyncCall( sink.get() );
+            } );
+        }
+    }
+
+    void consume(std::function< void(std::span< Event >) > handler) {
+        auto shared = std::make_shared< std::function< void(std::span< Event >) > >( std::move( handler ) );
+        for ( unsigned i = 0; i < std::max( state->options.consumers, 1u ); ++i ) {
+            consumers.emplace_back( [state = state, shared] (const std::stop_token stop) {
+                std::vector< Event > batch;
+                batch.reserve( state->options.batchSize );
+                while ( !stop.stop_requested() ) {
+                    if ( state->channel.pop( batch, state->options.batchSize, state->options.pollInterval ) == 0 ) continue;
+                    try { ( *shared )( batch ); }
+                    catch ( ... ) { state->fail( std::current_exception() ); }
+                    batch.clear();
+                }
+            } );
+        }
+    }
+
+    utils::ComPtr< IWbemServices > pSvc;
+    utils::ComPtr< IWbemObjectSink > sink;
+    std::shared_ptr< State > state;
+    ComThreading threading;
+    // Registration of a CallerManaged proxy, through which the watchdog cancels the call.
+    std::shared_ptr< utils::GlobalServices > shared;
+    std::vector< std::jthread > consumers;
+};
+
+class EventSink final : public IWbemObjectSink {
+public:
+    EventSink(std::shared_ptr< EventSubscription::State > state, const std::wstring &schemaScope, QueryOptions options)
+        : state( std::move( state ) ), events( schemaScope ), instances( schemaScope ), options( std::move( options ) ) {}
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++refCount; }
+
+    ULONG STDMETHODCALLTYPE Release() override {
+        const ULONG remaining = --refCount;
+        if ( remaining == 0 ) { delete this; }
+        return remaining;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppv) override {
+        if ( IsEqualIID( riid, IID_IUnknown ) || IsEqualIID( riid, IID_IWbemObjectSink ) ) {
+            *ppv = static_cast< IWbemObjectSink * >( this );
+            AddRef();
+            return WBEM_S_NO_ERROR;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    // Conversion is serialized, queueing is not: a blocked push holds back only its own call.
+    HRESULT STDMETHODCALLTYPE Indicate(long lObjectCount, IWbemClassObject **apObjArray) override {
+        for ( long i = 0; i < lObjectCount; ++i ) {
+            std::optional< Event > event;
+            {
+                std::lock_guard lock( mutex );
+                try { event = convert( apObjArray[ i ] ); }
+                catch ( ... ) { state->fail( std::current_exception() ); }
+            }
+            if ( event ) { state->channel.push( std::move( *event ) ); }
+        }
+        return WBEM_S_NO_ERROR;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetStatus(long lFlags, HRESULT hResult, BSTR, IWbemClassObject *) override {
+        if ( lFlags == WBEM_STATUS_COMPLETE ) {
+            state->status = hResult;
+            state->channel.close();
+        }
+        return WBEM_S_NO_ERROR;
+    }
+
+private:
+    Event convert(IWbemClassObject *pclsObj) {
+        return {
+            WindowsManagementInstrumentationClient::buildObject( pclsObj, events, options ),
+            embedded( pclsObj, L"TargetInstance" ),
+            embedded( pclsObj, L"PreviousInstance" )
+        };
+    }
+
+    std::optional< WindowsManagementInstrumentationObject > embedded(IWbemClassObject *pclsObj, const wchar_t *name) {
+        utils::Variant vtProp;
+        if ( FAILED( pclsObj->Get( name, 0, vtProp.put(), nullptr, nullptr ) ) ) return std::nullopt;
+        if ( vtProp.get().vt != VT_UNKNOWN || !vtProp.get().punkVal ) return std::nullopt;
+
+        utils::ComPtr< IWbemClassObject > instance;
+        const HRESULT hr = vtProp.get().punkVal->QueryInterface(
+            IID_IWbemClassObject, reinterpret_cast< void ** >( instance.put() ) );
+        THROW_IF_FAILED( hr );
+        return WindowsManagementInstrumentationClient::buildObject( instance.get(), instances, options );
+    }
+
+    std::atomic< ULONG > refCount = 0;
+    std::shared_ptr< EventSubscription::State > state;
+    std::mutex mutex;
+    SchemaCache::Scope events;
+    SchemaCache::Scope instances;
+    QueryOptions options;
+};
+
+inline EventSubscription WindowsManagementInstrumentationClient::subscribe(
+    const EventQuery &query, const EventOptions &options) const {
+    auto state = std::make_shared< EventSubscription::State >( options );
+
+    // Events outlive any arena the default options might name, and are read on consumer threads.
+    QueryOptions extraction = defaultOptions;
+    extraction.arena = nullptr;
+    extraction.lazy = false;
+    utils::ComPtr< IWbemObjectSink > sink( new EventSink( state, path + L"|*|", extraction ) );
+
+    const _bstr_t wql( query.wql().c_str() );
+    auto pServices = services();
+    const auto exec = [&] { return pServices->ExecNotificationQueryAsync( utils::wqlLanguage(), wql, 0, nullptr, sink.get() ); };
+    run( [&] {
+        HRESULT hr = exec();
+        if ( reconnect( hr, pServices ) ) { hr = exec(); }
+        THROW_IF_FAILED( hr );
+    } );
+
+    return { std::move( pServices ), std::move( sink ), std::move( state ), threading };
+}
+
+inline EventSubscription WindowsManagementInstrumentationClient::subscribe(
+    const EventQuery &query, std::function< void(std::span< Event >) > handler, const EventOptions &options) const {
+    EventSubscription subscription = subscribe( query, options );
+    subscription.consume( std::move( handler ) );
+    return subscription;
+}
+
+// Keeps preallocated objects up to date through IWbemRefresher. After the first few samples a
+// refresh() performs no allocations for scalar properties: values are rewritten in place.
+class Refresher {
+public:
+    class Enum {
+    public:
+        [[nodiscard]] std::span< const WindowsManagementInstrumentationObject > objects() const noexcept {
+            return { instances.data(), active };
+        }
+
+    private:
+        friend class Refresher;
+        utils::ComPtr< IWbemHiPerfEnum > hiPerfEnum;
+        utils::ComBatch< IWbemObjectAccess > batch{ 64 };
+        std::shared_ptr< const ClassSchema > schema;
+        std::vector< WindowsManagementInstrumentationObject > instances;
+        std::size_t active = 0;
+    };
+
+    explicit Refresher(const WindowsManagementInstrumentationClient &client)
+        : pSvc( client.services() ), threading( client.threading ) {
+        utils::runIn( threading, [this] {
+            HRESULT hr = CoCreateInstance( CLSID_WbemRefresher, nullptr, CLSCTX_INPROC_SERVER,
+                                           IID_IWbemRefresher, reinterpret_cast< LPVOID * >( pRefresher.put() ) );
+            THROW_IF_FAILED( hr );
+
+            hr = pRefresher->QueryInterface( IID_IWbemConfigureRefresher, reinterpret_cast< void ** >( pConfig.put() ) );
+            THROW_IF_FAILED( hr );
+        } );
+    }
+
+    Refresher(Refresher &&) noexcept = default;
+
+    // The refresher and its enumerators are released in the apartment they were created in.
+    ~Refresher() noexcept {
+        utils::runIn( threading, [this] {
+            enums.clear();
+            instances.clear();
+            pConfig.reset();
+            pRefresher.reset();
+            pSvc.reset();
+        } );
+    }
+
+    // Tracks every instance of a class; the object list follows instances appearing and disappearing.
+    const Enum &addEnum(const std::wstring &className) {
+        return utils::runIn( threading, [&] () -> const Enum & {
+            auto entry = std::make_unique< Enum >();
+            long id = 0;
+            const HRESULT hr = pConfig->AddEnum( pSvc.get(), className.c_str(), 0, nullptr, entry->hiPerfEnum.put(), &id );
+            THROW_IF_FAILED( hr );
+
+            enums.push_back( std::move( entry ) );
+            return *enums.back();
+        } );
+    }
+
+    // Tracks a single instance, e.g. L"Win32_PerfFormattedData_PerfOS_Processor.Name=\"_Total\"".
+    const WindowsManagementInstrumentationObject &addObject(const std::wstring &path) {
+        return utils::runIn( threading, [&] () -> const WindowsManagementInstrumentationObject & {
+            auto entry = std::make_unique< Instance >();
+            utils::ComPtr< IWbemClassObject > refreshed;
+            long id = 0;
+            HRESULT hr = pConfig->AddObjectByPath( pSvc.get(), path.c_str(), 0, nullptr, refreshed.put(), &id );
+            THROW_IF_FAILED( hr );
+
+            hr = refreshed->QueryInterface( IID_IWbemObjectAccess, reinterpret_cast< void ** >( entry->access.put() ) );
+            THROW_IF_FAILED( hr );
+
+            entry->schema = recordSchema( entry->access.get() );
+            entry->object.rebind( entry->schema );
+            instances.push_back( std::move( entry ) );
+            return instances.back()->object;
+        } );
+    }
+
+    void refresh() {
+        utils::runIn( threading, [this] {
+            HRESULT hr = pRefresher->Refresh( 0L );
+            THROW_IF_FAILED( hr );
+
+            for ( const auto &entry: enums ) { refreshEnum( *entry ); }
+            for ( const auto &entry: instances ) { update( entry->access.get(), *entry->schema, entry->object ); }
+        } );
+    }
+
+private:
+    struct Instance {
+        utils::ComPtr< IWbemObjectAccess > access;
+        std::shared_ptr< const ClassSchema > schema;
+        WindowsManagementInstrumentationObject object;
+    };
+
+    static void refreshEnum(Enum &entry) {
+        entry.batch.release();
+        HRESULT hr = entry.hiPerfEnum->GetObjects( 0L, entry.batch.capacity(), entry.batch.data(), entry.batch.count() );
+        if ( hr == WBEM_E_BUFFER_TOO_SMALL ) {
+            // Nothing was returned; the count holds the required capacity.
+            entry.batch.reserve( std::exchange( *entry.batch.count(), 0 ) );
+            hr = entry.hiPerfEnum->GetObjects( 0L, entry.batch.capacity(), entry.batch.data(), entry.batch.count() );
+        }
+        THROW_IF_FAILED( hr );
+
+        const auto objects = entry.batch.objects();
+        if ( objects.empty() ) {
+            entry.active = 0;
+            return;
+        }
+        if ( !entry.schema ) { entry.schema = recordSchema( objects.front() ); }
+
+        if ( objects.size() > entry.instances.size() ) {
+            std::size_t bound = entry.instances.size();
+            entry.instances.resize( objects.size() );
+            for ( ; bound < entry.instances.size(); ++bound ) { entry.instances[ bound ].rebind( entry.schema ); }
+        }
+
+        for ( std::size_t i = 0; i < objects.size(); ++i ) { update( objects[ i ], *entry.schema, entry.instances[ i ] ); }
+        entry.active = objects.size();
+    }
+
+    static std::shared_ptr< const ClassSchema > recordSchema(IWbemObjectAccess *access) {
+        std::wstring className;
+        {
+            utils::Variant vtClass;
+            const HRESULT hr = access->Get( L"__CLASS", 0, vtClass.put(), nullptr, nullptr );
+            THROW_IF_FAILED( hr );
+            if ( vtClass.get().vt == VT_BSTR && vtClass.get().bstrVal ) { className = vtClass.get().bstrVal; }
+        }
+
+        // System properties never change between samples, so only the class' own properties are tracked.
+        HRESULT hr = access->BeginEnumeration( WBEM_FLAG_NONSYSTEM_ONLY );
+        THROW_IF_FAILED( hr );
+        utils::EnumerationScope enumeration( access );
+
+        std::vector< PropertySchema > properties;
+        while ( true ) {
+            BSTR bstrName = nullptr;
+            CIMTYPE cimType;
+            LONG flFlavor = 0;
+            hr = access->Next( 0, &bstrName, nullptr, &cimType, &flFlavor );
+            if ( hr == WBEM_S_NO_MORE_DATA ) break;
+            THROW_IF_FAILED( hr );
+
+            properties.push_back( { std::wstring( bstrName, SysStringLen( bstrName ) ), cimType, flFlavor } );
+            SysFreeString( bstrName );
+        }
+
+        WindowsManagementInstrumentationClient::resolveHandles( access, properties );
+        return std::make_shared< const ClassSchema >( std::move( className ), std::move( properties ) );
+    }
+
+    // Values are rewritten in place at their schema index, so their buffers are reused across samples.
+    static void update(IWbemObjectAccess *access, const ClassSchema &schema, WindowsManagementInstrumentationObject &obj) {
+        const auto properties = schema.properties();
+        for ( std::size_t i = 0; i < properties.size(); ++i ) {
+            WmiValue &slot = obj.values[ i ];
+            if ( WindowsManagementInstrumentationClient::readPropertyHandle( access, properties[ i ], slot ) ) continue;
+
+            utils::Variant vtProp;
+            CIMTYPE cimType;
+            const HRESULT hr = access->Get( properties[ i ].name.c_str(), 0, vtProp.put(), &cimType, nullptr );
+            THROW_IF_FAILED( hr );
+            utils::convertVariant( vtProp.get(), cimType, slot );
+        }
+    }
+
+    utils::ComPtr< IWbemServices > pSvc;
+    utils::ComPtr< IWbemRefresher > pRefresher;
+    utils::ComPtr< IWbemConfigureRefresher > pConfig;
+    std::vector< std::unique_ptr< Enum > > enums;
+    std::vector< std::unique_ptr< Instance > > instances;
+    ComThreading threading;
+};
+
+struct QueryRequest {
+    std::wstring className;
+    // Properties to select; empty selects every property.
+    std::vector< std::wstring > properties;
+    QueryOptions options;
+};
+
+struct QueryResult {
+    // Position of the request in the list handed to the scheduler.
+    std::size_t index = 0;
+    std::vector< WindowsManagementInstrumentationObject > objects;
+    std::chrono::steady_clock::duration elapsed{};
+    // Set instead of `objects` when the query failed.
+    std::exception_ptr error;
+};
+
+// Runs independent queries concurrently on a bounded set of threads, each with its own client on
+// a pooled connection, so a batch takes about as long as its slowest query.
+class QueryScheduler {
+public:
+    // `workers` of 0 uses one thread per hardware thread.
+    explicit QueryScheduler(ConnectionOptions connection = {}, const std::size_t workers = 0)
+        : connection( std::move( connection ) ),
+          workers( workers ? workers : std::max( 1u, std::thread::hardware_concurrency() ) ) {
+        // Scheduler threads are owned here, so they always initialize their own apartment.
+        this->connection.threading = ComThreading::Managed;
+    }
+
+    // Calls onResult as each query completes, one call at a time, from the scheduler's threads.
+    // Returns once every request has been reported.
+    void run(std::span< const QueryRequest > requests, const std::function< void(QueryResult &&) > &onResult) const {
+        std::atomic< std::size_t > next = 0;
+        std::mutex reporting;
+        std::exception_ptr connectFailure;
+
+        const auto report = [&] (QueryResult &&result) {
+            std::lock_guard lock( reporting );
+            onResult( std::move( result ) );
+        };
+
+        const auto work = [&] {
+            std::optional< WindowsManagementInstrumentationClient > client;
+            try { client.emplace( connection ); }
+            catch ( ... ) {
+                std::lock_guard lock( reporting );
+                if ( !connectFailure ) { connectFailure = std::current_exception(); }
+                return;
+            }
+
+            for ( std::size_t index = next++; index < requests.size(); index = next++ ) {
+                const auto &request = requests[ index ];
+                QueryResult result;
+                result.index = index;
+
+                const auto start = std::chrono::steady_clock::now();
+                try {
+                    client->streamQuery( Query( request.className ).select( request.properties ),
+                                         [&] (WindowsManagementInstrumentationObject &&obj) { result.objects.push_back( std::move( obj ) ); },
+                                         request.options );
+                }
+                catch ( ... ) { result.error = std::current_exception(); }
+                result.elapsed = std::chrono::steady_clock::now() - start;
+                report( std::move( result ) );
+            }
+        };
+
+        std::vector< std::thread > threads;
+        const std::size_t count = std::min( workers, requests.size() );
+        threads.reserve( count );
+        for ( std::size_t i = 0; i < count; ++i ) { threads.emplace_back( work ); }
+        for ( auto &thread: threads ) { thread.join(); }
+
+        // Requests nobody picked up because no worker could connect.
+        for ( std::size_t index = next; index < requests.size(); ++index ) {
+            QueryResult result;
+            result.index = index;
+            result.error = connectFailure;
+            report( std::move( result ) );
+        }
+    }
+
+    // Runs every request and returns the results in request order.
+    std::vector< QueryResult > run(std::span< const QueryRequest > requests) const {
+        std::vector< QueryResult > results( requests.size() );
+        run( requests, [&] (QueryResult &&result) { results[ result.index ] = std::move( result ); } );
+        return results;
+    }
+
+private:
+    ConnectionOptions connection;
+    std::size_t workers;
+};
+
+struct HostResult {
+    // Position of the host in the list handed to run().
+    std::size_t index = 0;
+    std::wstring host;
+    std::vector< WindowsManagementInstrumentationObject > objects;
+    std::chrono::steady_clock::duration elapsed{};
+    // Set instead of `objects` when the host failed; WBEM_E_TIMED_OUT once its time ran out.
+    std::exception_ptr error;
+};
+
+// Runs one query against many hosts at once, at most `parallelism` at a time, each on a pooled
+// connection of its own. A host that is still connecting or querying when its timeout passes is
+// reported as timed out and left behind, so it never holds up the rest of the batch. Threads of
+// hosts left behind are joined by the destructor, which must run before ConnectionPool::shutdown().
+class HostFanOut {
+public:
+    // `connection` holds the namespace and credentials for every host; its host is replaced.
+    // A `hostTimeout` of zero waits for every host.
+    explicit HostFanOut(
+        ConnectionOptions connection = {}, const std::size_t parallelism = 16,
+        const std::chrono::milliseconds hostTimeout = std::chrono::seconds( 30 ))
+        : connection( std::move( connection ) ), parallelism( std::max< std::size_t >( parallelism, 1 ) ),
+          hostTimeout( hostTimeout ) {
+        // Every host runs on a thread of its own, which initializes its own apartment.
+        this->connection.threading = ComThreading::Managed;
+    }
+
+    HostFanOut(const HostFanOut &) = delete;
+    HostFanOut &operator=(const HostFanOut &) = delete;
+
+    // Calls onResult on the calling thread as each host completes, times out or is cancelled
+    // through options.cancellation. Returns once every host has been reported.
+    void run(
+        std::span< const std::wstring > hosts, const Query &query, const QueryOptions &options,
+        const std::function< void(HostResult &&) > &onResult) const {
+        using Clock = std::chrono::steady_clock;
+
+        struct Running {
+            std::size_t index;
+            Clock::time_point started;
+            Clock::time_point deadline;
+            std::jthread worker;
+        };
+        struct Expired {
+            std::size_t index;
+            HRESULT reason;
+            Clock::duration elapsed;
+        };
+
+        joinExited();
+
+        auto batch = std::make_shared< Batch >();
+        batch->abandoned.assign( hosts.size(), 0 );
+        batch->exited.assign( hosts.size(), 0 );
+        std::vector< Running > running;
+        std::size_t next = 0;
+        std::size_t reported = 0;
+
+        const auto start = [&] (const std::size_t index) {
+            const auto now = Clock::now();
+            Running host{ index, now, hostTimeout.count() > 0 ? now + hostTimeout : Clock::time_point::max(), {} };
+
+            ConnectionOptions target = connection;
+            target.host = hosts[ index ];
+            QueryOptions hostOptions = options;
+            if ( hostTimeout.count() > 0 ) { hostOptions.timeout = hostTimeout; }
+            // Arenas are not shared across threads.
+            hostOptions.arena = nullptr;
+
+            // The thread's own stop token cancels the host's query once it is left behind.
+            host.worker = std::jthread(
+                [batch, index, target = std::move( target ), query, hostOptions = std::move( hostOptions )]
+                (const std::stop_token stop) mutable {
+                    hostOptions.cancellation = stop;
+                    HostResult result;
+                    result.index = index;
+                    result.host = target.host;
+                    const auto begin = Clock::now();
+                    try {
+                        WindowsManagementInstrumentationClient client( target );
+                        client.streamProperties( query, [&] (WindowsManagementInstrumentationObject &&obj) {
+                            result.objects.push_back( std::move( obj ) );
+                        }, hostOptions );
+                    }
+                    catch ( ... ) {
+                        result.objects.clear();
+                        result.error = std::current_exception();
+                    }
+                    result.elapsed = Clock::now() - begin;
+
+                    std::lock_guard lock( batch->mutex );
+                    batch->exited[ index ] = 1;
+                    if ( batch->abandoned[ index ] ) return;
+                    batch->finished.push_back( std::move( result ) );
+                    batch->done.notify_one();
+                } );
+            running.push_back( std::move( host ) );
+        };
+
+        const auto abandon = [&] (const std::size_t index, const HRESULT hr, const Clock::duration elapsed) {
+            HostResult result;
+            result.index = index;
+            result.host = hosts[ index ];
+            result.elapsed = elapsed;
+            result.error = std::make_exception_ptr( utils::Exception( hr ) );
+            onResult( std::move( result ) );
+            ++reported;
+        };
+
+        while ( reported < hosts.size() ) {
+            const bool cancelled = options.cancellation.stop_requested();
+            while ( !cancelled && next < hosts.size() && running.size() < parallelism ) { start( next++ ); }
+
+            std::deque< HostResult > finished;
+            std::vector< Expired > expired;
+            // Threads of finished hosts, joined outside the lock that they take last.
+            std::vector< std::jthread > exited;
+            std::vector< Straggler > abandoned;
+            {
+                std::unique_lock lock( batch->mutex );
+                auto wake = Clock::now() + options.pollInterval;
+                for ( const auto &host: running ) { wake = std::min( wake, host.deadline ); }
+                batch->done.wait_until( lock, wake, [&] { return !batch->finished.empty(); } );
+
+                finished.swap( batch->finished );
+                const auto now = Clock::now();
+                const bool stopping = options.cancellation.stop_requested();
+                std::vector< Running > waiting;
+                for ( auto &host: running ) {
+                    if ( batch->exited[ host.index ] ) {
+                        exited.push_back( std::move( host.worker ) );
+                    } else if ( !stopping && now < host.deadline ) {
+                        waiting.push_back( std::move( host ) );
+                    } else {
+                        batch->abandoned[ host.index ] = 1;
+                        host.worker.request_stop();
+                        // A host whose time ran out is reported as timed out, even once the batch is cancelled.
+                        const HRESULT reason = now < host.deadline ? WBEM_E_CALL_CANCELLED : WBEM_E_TIMED_OUT;
+                        expired.push_back( { host.index, reason, now - host.started } );
+                        abandoned.push_back( { batch, host.index, std::move( host.worker ) } );
+                    }
+                }
+                running.swap( waiting );
+            }
+            exited.clear();
+            leaveBehind( abandoned );
+
+            for ( auto &result: finished ) {
+                onResult( std::move( result ) );
+                ++reported;
+            }
+            for ( const auto &host: expired ) { abandon( host.index, host.reason, host.elapsed ); }
+
+            // Hosts that were never started once the batch is cancelled.
+            if ( options.cancellation.stop_requested() && running.empty() ) {
+                for ( ; next < hosts.size(); ++next ) { abandon( next, WBEM_E_CALL_CANCELLED, {} ); }
+            }
+        }
+    }
+
+    void run(
+        std::span< const std::wstring > hosts, const Query &query,
+        const std::function< void(HostResult &&) > &onResult) const {
+        run( hosts, query, QueryOptions(), onResult );
+    }
+
+    // Runs the query on every host and returns the results in host order.
+    std::vector< HostResult > run(
+        std::span< const std::wstring > hosts, const Query &query, const QueryOptions &options = {}) const {
+        std::vector< HostResult > results( hosts.size() );
+        run( hosts, query, options, [&] (HostResult &&result) { results[ result.index ] = std::move( result ); } );
+        return results;
+    }
+
+private:
+    // State of one run, shared with its host threads.
+    struct Batch {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::deque< HostResult > finished;
+        std::vector< char > abandoned;
+        std::vector< char > exited;
+    };
+
+    // The thread of a host that was left behind; its stop has been requested.
+    struct Straggler {
+        std::shared_ptr< Batch > batch;
+        std::size_t index;
+        std::jthread worker;
+    };
+
+    void leaveBehind(std::vector< Straggler > &abandoned) const {
+        if ( abandoned.empty() ) return;
+        std::lock_guard lock( mutex );
+        for ( auto &straggler: abandoned ) { stragglers.push_back( std::move( straggler ) ); }
+    }
+
+    // Joins the stragglers that have exited since, so a long-lived fan-out does not collect them.
+    void joinExited() const {
+        // Declared before the lock, so they are joined once it is released.
+        std::vector< Straggler > exited;
+        std::lock_guard lock( mutex );
+        std::vector< Straggler > remaining;
+        for ( auto &straggler: stragglers ) {
+            std::unique_lock batchLock( straggler.batch->mutex );
+            const bool done = straggler.batch->exited[ straggler.index ];
+            batchLock.unlock();
+            ( done ? exited : remaining ).push_back( std::move( straggler ) );
+        }
+        stragglers.swap( remaining );
+    }
+
+    ConnectionOptions connection;
+    std::size_t parallelism;
+    std::chrono::milliseconds hostTimeout;
+    mutable std::mutex mutex;
+    // Declared last, so the destructor joins them while everything else is still alive.
+    mutable std::vector< Straggler > stragglers;
+};
+
+namespace utils {
+    // 64-bit FNV-1a, used for the content hashes of snapshots.
+    class Fnv1a {
+    public:
+        void add(const void *data, const std::size_t size) noexcept {
+            const auto *bytes = static_cast< const unsigned char * >( data );
+            for ( std::size_t i = 0; i < size; ++i ) { state = ( state ^ bytes[ i ] ) * 0x100000001b3ull; }
+        }
+
+        template< typename T >
+        void add(const T &value) noexcept {
+            static_assert( std::is_trivially_copyable_v< T > );
+            add( &value, sizeof( T ) );
+        }
+
+        void addString(const std::wstring_view str) noexcept {
+            add( str.size() );
+            add( str.data(), str.size() * sizeof( wchar_t ) );
+        }
+
+        [[nodiscard]] uint64_t value() const noexcept { return state; }
+
+    private:
+        uint64_t state = 0xcbf29ce484222325ull;
+    };
+
+    // Strings hash alike whichever storage they were extracted with.
+    inline uint64_t hashValue(const WmiValue &value) noexcept {
+        Fnv1a hash;
+        std::visit( [&] (const auto &v) {
+            using T = std::decay_t< decltype( v ) >;
+            if constexpr ( std::is_same_v< T, std::wstring > || std::is_same_v< T, std::wstring_view > ) {
+                hash.add( std::variant_npos );
+                hash.addString( v );
+            }
+            else if constexpr ( std::is_same_v< T, BStr > ) {
+                hash.add( std::variant_npos );
+                hash.addString( v.view() );
+            }
+            else if constexpr ( std::is_same_v< T, std::vector< bool > > ) {
+                hash.add( value.index() );
+                hash.add( v.size() );
+                for ( const bool element: v ) { hash.add( element ); }
+            }
+            else if constexpr ( std::is_same_v< T, std::vector< std::wstring > > ) {
+                hash.add( value.index() );
+                hash.add( v.size() );
+                for ( const auto &element: v ) { hash.addString( element ); }
+            }
+            else if constexpr ( isVector< T > ) {
+                hash.add( value.index() );
+                hash.add( v.size() );
+                hash.add( v.data(), v.size() * sizeof( typename T::value_type ) );
+            }
+            else if constexpr ( std::is_same_v< T, std::monostate > ) { hash.add( value.index() ); }
+            else {
+                hash.add( value.index() );
+                hash.add( v );
+            }
+        }, value );
+        return hash.value();
+    }
+
+    // Appends a key property in text form; keys are never arrays.
+    inline void appendKey(std::wstring &key, const WmiValue &value) {
+        std::visit( [&] (const auto &v) {
+            using T = std::decay_t< decltype( v ) >;
+            if constexpr ( std::is_same_v< T, std::wstring > || std::is_same_v< T, std::wstring_view > ) { key += v; }
+            else if constexpr ( std::is_same_v< T, BStr > ) { key += v.view(); }
+            else if constexpr ( std::is_arithmetic_v< T > ) { key += wqlLiteral( v ); }
+            // A NULL key, such as the __RELPATH of a query that leaves out the keys, contributes nothing.
+            else if constexpr ( std::is_same_v< T, std::monostate > ) {}
+            else { throw Exception( WBEM_E_TYPE_MISMATCH ); }
+        }, value );
+    }
+}
+
+// The previous result of a query, kept as per-object content hashes, that the next result is
+// diffed against. Objects are matched by their key properties, or by __RELPATH if none are given;
+// __RELPATH is only filled in when the query selects the class's keys.
+class Snapshot {
+public:
+    struct Change {
+        WindowsManagementInstrumentationObject object;
+        // Properties whose value differs, and those only one of the two versions has.
+        std::vector< std::wstring > properties;
+    };
+
+    struct Delta {
+        std::vector< WindowsManagementInstrumentationObject > added;
+        std::vector< Change > changed;
+        // Keys of the objects that are gone.
+        std::vector< std::wstring > removed;
+
+        [[nodiscard]] bool empty() const noexcept { return added.empty() && changed.empty() && removed.empty(); }
+    };
+
+    Snapshot() = default;
+    explicit Snapshot(std::vector< std::wstring > keyProperties) : keyProperties( std::move( keyProperties ) ) {}
+
+    // Replaces the snapshot with `objects` and returns what changed. Unchanged objects are dropped;
+    // the first update reports every object as added. Objects whose keys or values cannot be read,
+    // e.g. lazy ones whose Get fails, or two objects with the same key, fail the update and leave
+    // the snapshot as it was; duplicates throw WBEM_E_INVALID_PARAMETER, as the key properties do
+    // not identify the objects.
+    Delta update(std::vector< WindowsManagementInstrumentationObject > objects) {
+        // Everything that can throw is read before the snapshot changes.
+        const uint64_t next = generation + 1;
+        std::vector< std::wstring > keys;
+        std::vector< Entry > hashes;
+        keys.reserve( objects.size() );
+        hashes.reserve( objects.size() );
+        for ( const auto &obj: objects ) {
+            keys.push_back( keyOf( obj ) );
+            hashes.push_back( hashOf( obj, next ) );
+        }
+
+        std::vector< std::wstring_view > sorted( keys.begin(), keys.end() );
+        std::ranges::sort( sorted );
+        if ( std::ranges::adjacent_find( sorted ) != sorted.end() ) throw utils::Exception( WBEM_E_INVALID_PARAMETER );
+
+        Delta delta;
+        generation = next;
+        for ( std::size_t i = 0; i < objects.size(); ++i ) {
+            auto &obj = objects[ i ];
+            std::wstring &key = keys[ i ];
+            Entry &current = hashes[ i ];
+
+            const auto it = entries.find( key );
+            if ( it == entries.end() ) {
+                entries.emplace( std::move( key ), std::move( current ) );
+                delta.added.push_back( std::move( obj ) );
+                continue;
+            }
+            if ( it->second.hash != current.hash ) {
+                delta.changed.push_back( { std::move( obj ), changedProperties( it->second, current ) } );
+            }
+            it->second = std::move( current );
+        }
+
+        for ( auto it = entries.begin(); it != entries.end(); ) {
+            if ( it->second.generation == generation ) {
+                ++it;
+                continue;
+            }
+            auto node = entries.extract( it++ );
+            delta.removed.push_back( std::move( node.key() ) );
+        }
+        return delta;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return entries.size(); }
+    void clear() noexcept { entries.clear(); }
+
+private:
+    struct Entry {
+        uint64_t hash = 0;
+        std::shared_ptr< const ClassSchema > layout;
+        // One hash per schema property; system properties are not compared.
+        std::vector< uint64_t > properties;
+        uint64_t generation = 0;
+    };
+
+    static bool isSystem(const PropertySchema &prop) noexcept {
+        return ( prop.flavor & WBEM_FLAVOR_MASK_ORIGIN ) == WBEM_FLAVOR_ORIGIN_SYSTEM;
+    }
+
+    std::wstring keyOf(const WindowsManagementInstrumentationObject &obj) const {
+        if ( keyProperties.empty() ) {
+            const auto path = obj.getPropertyView( L"__RELPATH" );
+            if ( !path || path->empty() ) throw utils::Exception( WBEM_E_INVALID_OBJECT_PATH );
+            return std::wstring( *path );
+        }
+
+        std::wstring key;
+        for ( std::size_t i = 0; i < keyProperties.size(); ++i ) {
+            const WmiValue *value = obj.find( std::wstring_view( keyProperties[ i ] ) );
+            if ( !value ) throw utils::Exception( WBEM_E_NOT_FOUND );
+            if ( i > 0 ) { key += L'\x1f'; }
+            utils::appendKey( key, *value );
+        }
+        return key;
+    }
+
+    static Entry hashOf(const WindowsManagementInstrumentationObject &obj, const uint64_t seen) {
+        Entry entry{ 0, obj.layout, {}, seen };
+        if ( !obj.layout ) return entry;
+
+        const auto properties = obj.layout->properties();
+        entry.properties.reserve( properties.size() );
+        utils::Fnv1a hash;
+        for ( std::size_t i = 0; i < properties.size(); ++i ) {
+            const uint64_t value = isSystem( properties[ i ] ) ? 0 : utils::hashValue( obj.valueAt( i ) );
+            entry.properties.push_back( value );
+            if ( isSystem( properties[ i ] ) ) continue;
+            hash.addString( properties[ i ].name );
+            hash.add( value );
+        }
+        entry.hash = hash.value();
+        return entry;
+    }
+
+    static std::vector< std::wstring > changedProperties(const Entry &previous, const Entry &current) {
+        std::vector< std::wstring > names;
+        if ( !current.layout ) return names;
+
+        const auto properties = current.layout->properties();
+        for ( std::size_t i = 0; i < properties.size(); ++i ) {
+            if ( isSystem( properties[ i ] ) ) continue;
+            std::size_t old = i;
+            if ( previous.layout != current.layout ) {
+                old = previous.layout ? previous.layout->indexOf( properties[ i ].name ) : ClassSchema::npos;
+            }
+            if ( old == ClassSchema::npos || previous.properties[ old ] != current.properties[ i ] ) {
+                names.push_back( properties[ i ].name );
+            }
+        }
+
+        if ( previous.layout && previous.layout != current.layout ) {
+            for ( const auto &prop: previous.layout->properties() ) {
+                if ( !isSystem( prop ) && current.layout->indexOf( prop.name ) == ClassSchema::npos ) {
+                    names.push_back( prop.name );
+                }
+            }
+        }
+        return names;
+    }
+
+    std::vector< std::wstring > keyProperties;
+    std::unordered_map< std::wstring, Entry > entries;
+    uint64_t generation = 0;
+};
+
+namespace utils {
+    // Output buffer of the binary result format. Padding is relative to the start of the buffer,
+    // which readers require to be aligned to 8 bytes.
+    class BinaryWriter {
+    public:
+        explicit BinaryWriter(std::vector< std::byte > &out) : out( out ) {}
+
+        void varint(uint64_t value) {
+            while ( value >= 0x80 ) {
+                out.push_back( static_cast< std::byte >( value | 0x80 ) );
+                value >>= 7;
+            }
+            out.push_back( static_cast< std::byte >( value ) );
+        }
+
+        void align(const std::size_t alignment) { out.resize( ( out.size() + alignment - 1 ) & ~( alignment - 1 ) ); }
+
+        template< typename T >
+        void raw(const std::span< const T > values) {
+            align( alignof( T ) );
+            const std::size_t at = out.size();
+            out.resize( at + values.size_bytes() );
+            if ( !values.empty() ) { memcpy( out.data() + at, values.data(), values.size_bytes() ); }
+        }
+
+    private:
+        std::vector< std::byte > &out;
+    };
+
+    // Bounds-checked cursor over a binary result; running past the end means the data is corrupt.
+    class BinaryReader {
+    public:
+        explicit BinaryReader(const std::span< const std::byte > buffer) : buffer( buffer ) {}
+
+        [[noreturn]] static void corrupt() { throw Exception( ERROR_INVALID_DATA ); }
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for ( unsigned shift = 0; shift < 64; shift += 7 ) {
+                if ( pos >= buffer.size() ) corrupt();
+                const auto byte = static_cast< uint8_t >( buffer[ pos++ ] );
+                value |= static_cast< uint64_t >( byte & 0x7F ) << shift;
+                if ( !( byte & 0x80 ) ) return value;
+            }
+            corrupt();
+        }
+
+        std::size_t count() {
+            const uint64_t value = varint();
+            if ( value > buffer.size() ) corrupt();
+            return static_cast< std::size_t >( value );
+        }
+
+        void align(const std::size_t alignment) {
+            pos = ( pos + alignment - 1 ) & ~( alignment - 1 );
+            if ( pos > buffer.size() ) corrupt();
+        }
+
+        template< typename T >
+        const T *take(const std::size_t elements) {
+            align( alignof( T ) );
+            if ( elements > ( buffer.size() - pos ) / sizeof( T ) ) corrupt();
+            const auto *data = reinterpret_cast< const T * >( buffer.data() + pos );
+            pos += elements * sizeof( T );
+            return data;
+        }
+
+        [[nodiscard]] bool atEnd() const noexcept { return pos == buffer.size(); }
+
+    private:
+        std::span< const std::byte > buffer;
+        std::size_t pos = 0;
+    };
+
+    // Column element of a CIM base type: booleans are single bytes and strings string table indices.
+    template< CIMTYPE Type >
+    using ColumnElement = std::conditional_t< std::is_same_v< typename CimScalar< Type >::type, bool >, uint8_t,
+        std::conditional_t< std::is_same_v< typename CimScalar< Type >::type, std::wstring >, uint32_t,
+            typename CimScalar< Type >::type > >;
+}
+
+// Binary encoding of query results for IPC and spooling, read in place without parsing values.
+//
+// Objects are grouped by schema. Each schema stores its class, property names and types, followed
+// by one column per property: a bitmap of the rows that hold a value, then fixed-width values for
+// scalars, or an offset array plus the elements for arrays. Columns are aligned to their element
+// type, so arrays are handed out as spans into the buffer. Values are fixed-width rather than
+// varints so that a row's value is found from its index alone: reading one property of one object
+// decodes nothing else. Names and string values are interned into one UTF-16 string table at the
+// end. Counts and schema metadata are varints. The format is little-endian.
+class SerializedResultSet {
+    struct Column {
+        CIMTYPE type = CIM_EMPTY;
+        // One bit per row, set where the row holds a value.
+        const uint64_t *validity = nullptr;
+        const std::byte *data = nullptr;
+        // Array columns only: element range of each row.
+        const uint32_t *offsets = nullptr;
+        std::size_t elements = 0;
+    };
+
+    struct Block {
+        std::shared_ptr< const ClassSchema > schema;
+        std::size_t rows = 0;
+        std::vector< Column > columns;
+    };
+
+public:
+    // Read-only view of one serialized object, with the accessors of WindowsManagementInstrumentationObject.
+    class Object {
+    public:
+        [[nodiscard]] const ClassSchema *schema() const noexcept { return block->schema.get(); }
+
+        template< typename T >
+        std::optional< T > getProperty(const std::wstring_view prop) const {
+            const Column *column = find( prop );
+            if ( !column || ( column->type & CIM_FLAG_ARRAY ) || isNull( *column ) ) return std::nullopt;
+
+            std::optional< T > result;
+            if constexpr ( std::is_same_v< T, std::wstring > ) {
+                if ( const auto view = getPropertyView( prop ) ) { result.emplace( *view ); }
+            }
+            else {
+                utils::visitCimType( column->type, [&]< CIMTYPE Type > () {
+                    using Stored = typename utils::CimScalar< Type >::type;
+                    if constexpr ( std::is_same_v< Stored, T > ) {
+                        utils::ColumnElement< Type > element;
+                        memcpy( &element, column->data + row * sizeof( element ), sizeof( element ) );
+                        result = static_cast< T >( element );
+                    }
+                } );
+            }
+            return result;
+        }
+
+        // String properties point into the buffer.
+        std::optional< std::wstring_view > getPropertyView(const std::wstring_view prop) const {
+            const Column *column = find( prop );
+            if ( !column || !isString( column->type ) || isNull( *column ) ) return std::nullopt;
+            return set->string( reinterpret_cast< const uint32_t * >( column->data )[ row ] );
+        }
+
+        // Points into the buffer; strings arrays are read through getStringArray. Boolean elements
+        // are checked to be 0 or 1 before they are handed out as bool.
+        template< typename T >
+        std::span< const T > getArray(const std::wstring_view prop) const {
+            const Column *column = find( prop );
+            if ( !column || !( column->type & CIM_FLAG_ARRAY ) || isNull( *column ) ) return {};
+
+            std::span< const T > result;
+            utils::visitCimType( column->type & ~CIM_FLAG_ARRAY, [&]< CIMTYPE Type > () {
+                if constexpr ( std::is_same_v< typename utils::CimScalar< Type >::type, T > && !std::is_same_v< T, std::wstring > ) {
+                    static_assert( sizeof( utils::ColumnElement< Type > ) == sizeof( T ) );
+                    const auto [begin, end] = range( *column );
+                    if constexpr ( std::is_same_v< T, bool > ) {
+                        const auto *bytes = reinterpret_cast< const uint8_t * >( column->data );
+                        if ( std::any_of( bytes + begin, bytes + end, [] (const uint8_t byte) { return byte > 1; } ) ) {
+                            utils::BinaryReader::corrupt();
+                        }
+                    }
+                    result = { reinterpret_cast< const T * >( column->data ) + begin, end - begin };
+                }
+            } );
+            return result;
+        }
+
+        std::vector< std::wstring_view > getStringArray(const std::wstring_view prop) const {
+            std::vector< std::wstring_view > strings;
+            const Column *column = find( prop );
+            if ( !column || !( column->type & CIM_FLAG_ARRAY ) || !isString( column->type & ~CIM_FLAG_ARRAY ) || isNull( *column ) ) {
+                return strings;
+            }
+
+            const auto [begin, end] = range( *column );
+            const auto *ids = reinterpret_cast< const uint32_t * >( column->data );
+            strings.reserve( end - begin );
+            for ( std::size_t i = begin; i < end; ++i ) { strings.push_back( set->string( ids[ i ] ) ); }
+            return strings;
+        }
+
+    private:
+        friend class SerializedResultSet;
+
+        Object(const SerializedResultSet &set, const Block &block, const std::size_t row) : set( &set ), block( &block ), row( row ) {}
+
+        static bool isString(const CIMTYPE type) noexcept {
+            return type == CIM_STRING || type == CIM_DATETIME || type == CIM_REFERENCE;
+        }
+
+        bool isNull(const Column &column) const noexcept { return ( ( column.validity[ row / 64 ] >> ( row % 64 ) ) & 1 ) == 0; }
+
+        const Column *find(const std::wstring_view prop) const {
+            const std::size_t index = block->schema->indexOf( prop );
+            return index != ClassSchema::npos ? &block->columns[ index ] : nullptr;
+        }
+
+        // Offsets are checked on access rather than when the buffer is opened.
+        std::pair< std::size_t, std::size_t > range(const Column &column) const {
+            const std::size_t begin = column.offsets[ row ];
+            const std::size_t end = column.offsets[ row + 1 ];
+            if ( begin > end || end > column.elements ) utils::BinaryReader::corrupt();
+            return { begin, end };
+        }
+
+        const SerializedResultSet *set;
+        const Block *block;
+        std::size_t row;
+    };
+
+    class Iterator {
+    public:
+        using value_type = Object;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+        Object operator*() const { return ( *set )[ index ]; }
+        Iterator &operator++() {
+            ++index;
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++index;
+            return previous;
+        }
+        bool operator==(const Iterator &other) const noexcept { return index == other.index; }
+
+    private:
+        friend class SerializedResultSet;
+        Iterator(const SerializedResultSet &set, const std::size_t index) : set( &set ), index( index ) {}
+
+        const SerializedResultSet *set = nullptr;
+        std::size_t index = 0;
+    };
+
+    // Encodes the objects into `out`, replacing its contents but keeping its capacity.
+    static void write(std::span< const WindowsManagementInstrumentationObject > objects, std::vector< std::byte > &out);
+
+    static std::vector< std::byte > write(std::span< const WindowsManagementInstrumentationObject > objects) {
+        std::vector< std::byte > out;
+        write( objects, out );
+        return out;
+    }
+
+    // Opens an encoded result in place. Only the schemas are decoded; `buffer` must outlive the
+    // result set and every view taken from it, and be aligned to 8 bytes, as mapped files are.
+    explicit SerializedResultSet(std::span< const std::byte > buffer);
+
+    [[nodiscard]] std::size_t size() const noexcept { return count; }
+    [[nodiscard]] bool empty() const noexcept { return count == 0; }
+    [[nodiscard]] Iterator begin() const noexcept { return { *this, 0 }; }
+    [[nodiscard]] Iterator end() const noexcept { return { *this, count }; }
+
+    Object operator[](const std::size_t index) const {
+        const uint32_t blockIndex = objects[ index * 2 ];
+        const uint32_t row = objects[ index * 2 + 1 ];
+        if ( blockIndex >= blocks.size() || row >= blocks[ blockIndex ].rows ) utils::BinaryReader::corrupt();
+        return { *this, blocks[ blockIndex ], row };
+    }
+
+private:
+    static constexpr std::array< std::byte, 4 > magic{ std::byte{ 'S' }, std::byte{ 'W' }, std::byte{ 'R' }, std::byte{ 'S' } };
+    static constexpr uint64_t version = 1;
+
+    std::wstring_view string(const uint32_t id) const {
+        if ( id >= stringCount ) utils::BinaryReader::corrupt();
+        const std::size_t begin = stringOffsets[ id ];
+        const std::size_t end = stringOffsets[ id + 1 ];
+        if ( begin > end || end > units ) utils::BinaryReader::corrupt();
+        return { chars + begin, end - begin };
+    }
+
+    std::vector< Block > blocks;
+    // Block and row of every object, in their original order.
+    const uint32_t *objects = nullptr;
+    std::size_t count = 0;
+    const uint32_t *stringOffsets = nullptr;
+    std::size_t stringCount = 0;
+    const wchar_t *chars = nullptr;
+    std::size_t units = 0;
+};
+
+inline void SerializedResultSet::write(
+    const std::span< const WindowsManagementInstrumentationObject > objects, std::vector< std::byte > &out) {
+    out.clear();
+    utils::BinaryWriter writer( out );
+
+    // Objects of one query share their schema, so grouping by schema pointer finds the blocks.
+    std::vector< const ClassSchema * > schemas;
+    std::vector< std::vector< const WindowsManagementInstrumentationObject * > > rows;
+    std::vector< uint32_t > index;
+    index.reserve( objects.size() * 2 );
+    for ( const auto &obj: objects ) {
+        const auto it = std::find( schemas.begin(), schemas.end(), obj.layout.get() );
+        const std::size_t block = static_cast< std::size_t >( it - schemas.begin() );
+        if ( it == schemas.end() ) {
+            schemas.push_back( obj.layout.get() );
+            rows.emplace_back();
+        }
+        index.push_back( static_cast< uint32_t >( block ) );
+        index.push_back( static_cast< uint32_t >( rows[ block ].size() ) );
+        rows[ block ].push_back( &obj );
+    }
+
+    std::vector< std::wstring_view > strings;
+    std::unordered_map< std::wstring_view, uint32_t, utils::StringHash, utils::StringEqual > interned;
+    const auto intern = [&] (const std::wstring_view str) {
+        const auto [it, inserted] = interned.try_emplace( str, static_cast< uint32_t >( strings.size() ) );
+        if ( inserted ) { strings.push_back( str ); }
+        return it->second;
+    };
+    const auto stringOf = [] (const WmiValue &value) -> std::optional< std::wstring_view > {
+        if ( const auto *str = std::get_if< std::wstring >( &value ) ) return *str;
+        if ( const auto *str = std::get_if< utils::BStr >( &value ) ) return str->view();
+        if ( const auto *str = std::get_if< std::wstring_view >( &value ) ) return *str;
+        return std::nullopt;
+    };
+
+    out.insert( out.end(), magic.begin(), magic.end() );
+    writer.varint( version );
+    writer.varint( objects.size() );
+    writer.varint( schemas.size() );
+    writer.raw( std::span< const uint32_t >( index ) );
+
+    for ( std::size_t block = 0; block < schemas.size(); ++block ) {
+        const ClassSchema *schema = schemas[ block ];
+        const auto &members = rows[ block ];
+        const auto properties = schema ? schema->properties() : std::span< const PropertySchema >();
+
+        writer.varint( schema ? intern( schema->className() ) : intern( L"" ) );
+        writer.varint( members.size() );
+        writer.varint( properties.size() );
+        for ( const auto &prop: properties ) {
+            writer.varint( intern( prop.name ) );
+            writer.varint( static_cast< uint32_t >( prop.type ) );
+            writer.varint( static_cast< uint32_t >( prop.flavor ) );
+        }
+
+        for ( std::size_t p = 0; p < properties.size(); ++p ) {
+            const CIMTYPE type = properties[ p ].type;
+            const bool supported = utils::visitCimType( type & ~CIM_FLAG_ARRAY, [&]< CIMTYPE Type > () {
+                using T = typename utils::CimScalar< Type >::type;
+                using Element = utils::ColumnElement< Type >;
+
+                // NULLs and values of another type than the schema's, such as those of unfilled
+                // objects, are written as empty and left out of the validity bitmap.
+                const auto element = [&] (const auto &value) -> Element {
+                    if constexpr ( std::is_same_v< T, std::wstring > ) return intern( value );
+                    else return static_cast< Element >( value );
+                };
+                std::vector< uint64_t > validity( ( members.size() + 63 ) / 64 );
+                const auto markValid = [&] (const std::size_t row) { validity[ row / 64 ] |= uint64_t{ 1 } << ( row % 64 ); };
+
+                std::vector< Element > elements;
+                if ( !( type & CIM_FLAG_ARRAY ) ) {
+                    elements.reserve( members.size() );
+                    for ( std::size_t row = 0; row < members.size(); ++row ) {
+                        const WmiValue &value = members[ row ]->valueAt( p );
+                        if constexpr ( std::is_same_v< T, std::wstring > ) {
+                            const auto str = stringOf( value );
+                            elements.push_back( str ? element( *str ) : Element{} );
+                            if ( str ) { markValid( row ); }
+                        }
+                        else {
+                            const auto *scalar = std::get_if< T >( &value );
+                            elements.push_back( scalar ? element( *scalar ) : Element{} );
+                            if ( scalar ) { markValid( row ); }
+                        }
+                    }
+                    writer.raw( std::span< const uint64_t >( validity ) );
+                    writer.raw( std::span< const Element >( elements ) );
+                    return;
+                }
+
+                std::vector< uint32_t > offsets;
+                offsets.reserve( members.size() + 1 );
+                offsets.push_back( 0 );
+                for ( std::size_t row = 0; row < members.size(); ++row ) {
+                    if ( const auto *vec = std::get_if< std::vector< T > >( &members[ row ]->valueAt( p ) ) ) {
+                        for ( const auto &item: *vec ) { elements.push_back( element( item ) ); }
+                        markValid( row );
+                    }
+                    offsets.push_back( static_cast< uint32_t >( elements.size() ) );
+                }
+                writer.raw( std::span< const uint64_t >( validity ) );
+                writer.raw( std::span< const uint32_t >( offsets ) );
+                writer.raw( std::span< const Element >( elements ) );
+            } );
+            if ( !supported ) throw utils::Exception( E_NOTIMPL );
+        }
+    }
+
+    // Interned last, after every value has been seen.
+    std::vector< uint32_t > stringOffsets;
+    stringOffsets.reserve( strings.size() + 1 );
+    std::size_t totalUnits = 0;
+    stringOffsets.push_back( 0 );
+    for ( const auto &str: strings ) {
+        totalUnits += str.size();
+        stringOffsets.push_back( static_cast< uint32_t >( totalUnits ) );
+    }
+    writer.varint( strings.size() );
+    writer.varint( totalUnits );
+    writer.raw( std::span< const uint32_t >( stringOffsets ) );
+    writer.align( alignof( wchar_t ) );
+    for ( const auto &str: strings ) { writer.raw( std::span< const wchar_t >( str ) ); }
+}
+
+inline SerializedResultSet::SerializedResultSet(const std::span< const std::byte > buffer) {
+    if ( reinterpret_cast< uintptr_t >( buffer.data() ) % alignof( uint64_t ) != 0 ) throw utils::Exception( ERROR_INVALID_DATA );
+
+    utils::BinaryReader reader( buffer );
+    if ( !std::equal( magic.begin(), magic.end(), reader.take< std::byte >( magic.size() ) ) ) utils::BinaryReader::corrupt();
+    if ( reader.varint() != version ) throw utils::Exception( ERROR_INVALID_DATA );
+
+    count = reader.count();
+    blocks.resize( reader.count() );
+    objects = reader.take< uint32_t >( count * 2 );
+
+    // Names reference the string table at the end, so they are resolved once it has been found.
+    struct Names {
+        std::size_t className;
+        std::vector< PropertySchema > properties;
+        std::vector< std::size_t > ids;
+    };
+    std::vector< Names > names( blocks.size() );
+
+    for ( std::size_t b = 0; b < blocks.size(); ++b ) {
+        Block &block = blocks[ b ];
+        names[ b ].className = reader.count();
+        block.rows = reader.count();
+        const std::size_t properties = reader.count();
+
+        for ( std::size_t p = 0; p < properties; ++p ) {
+            names[ b ].ids.push_back( reader.count() );
+            PropertySchema prop;
+            prop.type = static_cast< CIMTYPE >( reader.varint() );
+            prop.flavor = static_cast< LONG >( reader.varint() );
+            names[ b ].properties.push_back( std::move( prop ) );
+        }
+
+        block.columns.resize( properties );
+        for ( std::size_t p = 0; p < properties; ++p ) {
+            Column &column = block.columns[ p ];
+            column.type = names[ b ].properties[ p ].type;
+            const bool supported = utils::visitCimType( column.type & ~CIM_FLAG_ARRAY, [&]< CIMTYPE Type > () {
+                using Element = utils::ColumnElement< Type >;
+                column.validity = reader.take< uint64_t >( ( block.rows + 63 ) / 64 );
+                if ( column.type & CIM_FLAG_ARRAY ) {
+                    column.offsets = reader.take< uint32_t >( block.rows + 1 );
+                    column.elements = column.offsets[ block.rows ];
+                }
+                else { column.elements = block.rows; }
+                column.data = reinterpret_cast< const std::byte * >( reader.take< Element >( column.elements ) );
+            } );
+            if ( !supported ) utils::BinaryReader::corrupt();
+        }
+    }
+
+    stringCount = reader.count();
+    units = reader.count();
+    stringOffsets = reader.take< uint32_t >( stringCount + 1 );
+    chars = reader.take< wchar_t >( units );
+    if ( !reader.atEnd() ) utils::BinaryReader::corrupt();
+
+    for ( std::size_t b = 0; b < blocks.size(); ++b ) {
+        auto &properties = names[ b ].properties;
+        for ( std::size_t p = 0; p < properties.size(); ++p ) {
+            properties[ p ].name.assign( string( static_cast< uint32_t >( std::min< std::size_t >( names[ b ].ids[ p ], UINT32_MAX ) ) ) );
+        }
+        blocks[ b ].schema = std::make_shared< const ClassSchema >(
+            std::wstring( string( static_cast< uint32_t >( std::min< std::size_t >( names[ b ].className, UINT32_MAX ) ) ) ),
+            std::move( properties ) );
+    }
+}
+
+// Read-only mapping of a whole file, such as a spooled result set.
+class MappedFile {
+public:
+    explicit MappedFile(const std::wstring &path) {
+        file = CreateFileW( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+        THROW_LAST_IF( file == INVALID_HANDLE_VALUE );
+
+        LARGE_INTEGER fileSize;
+        if ( !GetFileSizeEx( file, &fileSize ) ) {
+            const DWORD error = GetLastError();
+            close();
+            throw utils::Exception( error );
+        }
+        // Empty files cannot be mapped.
+        if ( fileSize.QuadPart == 0 ) return;
+
+        mapping = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if ( mapping ) { view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ); }
+        if ( !view ) {
+            const DWORD error = GetLastError();
+            close();
+            throw utils::Exception( error );
+        }
+        size = static_cast< std::size_t >( fileSize.QuadPart );
+    }
+
+    MappedFile(MappedFile &&other) noexcept
+        : file( std::exchange( other.file, INVALID_HANDLE_VALUE ) ), mapping( std::exchange( other.mapping, nullptr ) ),
+          view( std::exchange( other.view, nullptr ) ), size( std::exchange( other.size, 0 ) ) {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() noexcept { close(); }
+
+    // Page-aligned, so it can be opened as a SerializedResultSet directly.
+    [[nodiscard]] std::span< const std::byte > data() const noexcept { return { static_cast< const std::byte * >( view ), size }; }
+
+private:
+    void close() noexcept {
+        if ( view ) { UnmapViewOfFile( std::exchange( view, nullptr ) ); }
+        if ( mapping ) { CloseHandle( std::exchange( mapping, nullptr ) ); }
+        if ( file != INVALID_HANDLE_VALUE ) { CloseHandle( std::exchange( file, INVALID_HANDLE_VALUE ) ); }
+    }
+
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const void *view = nullptr;
+    std::size_t size = 0;
+};
 }